@@ -0,0 +1,87 @@
+#include "archive_io.h"
+#include "platform_specific.h"
+#include <vector>
+
+namespace // anonymous
+{
+
+size_t const read_ahead_buffer_size = 8 << 20;
+
+}; // anonymous
+
+namespace repo
+{
+
+void device_readers_t::acquire(uint64_t device, unsigned max_readers)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_released.wait(lock, [&]() { return m_readers[device] < max_readers; });
+    ++m_readers[device];
+}
+
+void device_readers_t::release(uint64_t device)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        --m_readers[device];
+    }
+    m_released.notify_all();
+}
+
+device_reader_t::device_reader_t(device_readers_t& readers, uint64_t device, unsigned max_readers)
+    : m_readers(readers)
+    , m_device(device)
+{
+    m_readers.acquire(m_device, max_readers);
+}
+
+device_reader_t::~device_reader_t()
+{
+    m_readers.release(m_device);
+}
+
+void read_packs_ahead(std::filesystem::path const& archive, uint64_t max_size)
+{
+    std::filesystem::path pack_dir = archive / "objects" / "pack";
+    if (!std::filesystem::is_directory(pack_dir))
+    {
+        pack_dir = archive / ".git" / "objects" / "pack";
+    }
+    std::error_code error;
+    std::vector<std::filesystem::path> indexes;
+    std::vector<std::filesystem::path> packs;
+    uint64_t size = 0;
+    for (std::filesystem::directory_iterator pentry(pack_dir, error), end; !error && (pentry != end); pentry.increment(error))
+    {
+        std::filesystem::path const& file = pentry->path();
+        if (file.extension() == ".idx")
+        {
+            indexes.push_back(file);
+        }
+        else if (file.extension() == ".pack")
+        {
+            std::error_code size_error;
+            uint64_t const file_size = pentry->file_size(size_error);
+            if (!size_error)
+            {
+                packs.push_back(file);
+                size += file_size;
+            }
+        }
+    }
+    if (size > max_size)
+    {
+        return;
+    }
+    // the indexes are looked up first
+    for (std::filesystem::path const& index : indexes)
+    {
+        read_ahead(index, read_ahead_buffer_size);
+    }
+    for (std::filesystem::path const& pack : packs)
+    {
+        read_ahead(pack, read_ahead_buffer_size);
+    }
+}
+
+}; // namespace repo
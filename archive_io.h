@@ -0,0 +1,48 @@
+#ifndef REPO_ARCHIVE_IO
+#define REPO_ARCHIVE_IO
+
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <mutex>
+
+namespace repo
+{
+
+// Counts the syncs which read from each device, so that a slow device,
+// e.g. a USB stick, is not read by more of them at once than it serves well
+class device_readers_t
+{
+public:
+    // Blocks while 'max_readers' syncs read from 'device'
+    void acquire(uint64_t device, unsigned max_readers);
+    void release(uint64_t device);
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_released;
+    std::map<uint64_t, unsigned> m_readers;
+};
+
+class device_reader_t
+{
+public:
+    device_reader_t(device_readers_t& readers, uint64_t device, unsigned max_readers);
+    ~device_reader_t();
+    device_reader_t(device_reader_t const&) = delete;
+    device_reader_t& operator=(device_reader_t const&) = delete;
+private:
+    device_readers_t& m_readers;
+    uint64_t m_device;
+};
+
+// Reads the pack files of the archive repository in 'archive' from start to
+// end with large reads, so that a clone finds them in the file cache instead
+// of reading them from slow media in the random order of its mapped windows.
+// Does nothing when they take more than 'max_size' bytes, since they would
+// not stay cached.
+void read_packs_ahead(std::filesystem::path const& archive, uint64_t max_size);
+
+}; // namespace repo
+
+#endif // REPO_ARCHIVE_IO
@@ -0,0 +1,225 @@
+#include "artifact_store.h"
+#include <fstream>
+#include <stdexcept>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+
+namespace // anonymous
+{
+
+/* archive layout, all integers little endian:
+   magic
+   { 'D' u32 path_length path }                      directory
+   { 'F' u32 path_length path u64 size data }        regular file
+   'E'                                               end of archive
+   */
+char const magic[] = "FSART1\n";
+size_t const buffer_size = 1 << 16;
+
+void write_uint(std::ostream& os, uint64_t value, size_t bytes)
+{
+    for (size_t i = 0; i < bytes; ++i)
+    {
+        os.put(static_cast<char>((value >> (8 * i)) & 0xff));
+    }
+}
+
+uint64_t read_uint(std::istream& is, size_t bytes)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i)
+    {
+        int c = is.get();
+        if (c == std::char_traits<char>::eof())
+        {
+            throw std::runtime_error("Truncated artifact");
+        }
+        value |= uint64_t(static_cast<unsigned char>(c)) << (8 * i);
+    }
+    return value;
+}
+
+void write_path(std::ostream& os, std::filesystem::path const& path)
+{
+    std::string const name = path.generic_string();
+    write_uint(os, name.size(), 4);
+    os.write(name.data(), name.size());
+}
+
+std::filesystem::path read_path(std::istream& is)
+{
+    std::string name(static_cast<size_t>(read_uint(is, 4)), '\0');
+    is.read(&name[0], name.size());
+    std::filesystem::path path(name);
+    // never unpack outside of the target directory
+    bool legal = is && !path.empty() && path.is_relative() && !path.has_root_name();
+    for (std::filesystem::path const& element : path)
+    {
+        legal = legal && (element != "..");
+    }
+    if (!legal)
+    {
+        throw std::runtime_error("Illegal path in artifact: '" + name + "'");
+    }
+    return path;
+}
+
+void pack(std::filesystem::path const& dir, std::ostream& os)
+{
+    std::vector<char> buffer(buffer_size);
+    os.write(magic, sizeof(magic) - 1);
+    for (std::filesystem::directory_entry const& entry : std::filesystem::recursive_directory_iterator(dir))
+    {
+        std::filesystem::path const relative = std::filesystem::relative(entry.path(), dir);
+        if (entry.is_directory())
+        {
+            os.put('D');
+            write_path(os, relative);
+        }
+        else if (entry.is_regular_file())
+        {
+            os.put('F');
+            write_path(os, relative);
+            uint64_t size = entry.file_size();
+            write_uint(os, size, 8);
+            std::ifstream ifs(entry.path(), std::ios::binary);
+            while (size)
+            {
+                std::streamsize const chunk = static_cast<std::streamsize>(std::min<uint64_t>(size, buffer.size()));
+                if (!ifs.read(buffer.data(), chunk))
+                {
+                    throw std::runtime_error("Cannot read '" + entry.path().string() + "'");
+                }
+                os.write(buffer.data(), chunk);
+                size -= chunk;
+            }
+        }
+    }
+    os.put('E');
+}
+
+void unpack(std::istream& is, std::filesystem::path const& dir)
+{
+    std::vector<char> buffer(buffer_size);
+    std::string header(sizeof(magic) - 1, '\0');
+    is.read(&header[0], header.size());
+    if (!is || header != magic)
+    {
+        throw std::runtime_error("Not an artifact");
+    }
+    std::filesystem::create_directories(dir);
+    for (int type = is.get(); type != 'E'; type = is.get())
+    {
+        if (type == 'D')
+        {
+            std::filesystem::create_directories(dir / read_path(is));
+        }
+        else if (type == 'F')
+        {
+            std::filesystem::path const path = dir / read_path(is);
+            uint64_t size = read_uint(is, 8);
+            std::filesystem::create_directories(path.parent_path());
+            std::ofstream ofs(path, std::ios::binary | std::ios::trunc);
+            while (size)
+            {
+                std::streamsize const chunk = static_cast<std::streamsize>(std::min<uint64_t>(size, buffer.size()));
+                if (!is.read(buffer.data(), chunk))
+                {
+                    throw std::runtime_error("Truncated artifact");
+                }
+                ofs.write(buffer.data(), chunk);
+                size -= chunk;
+            }
+            if (!ofs)
+            {
+                throw std::runtime_error("Cannot write '" + path.string() + "'");
+            }
+        }
+        else
+        {
+            throw std::runtime_error("Corrupt artifact");
+        }
+    }
+}
+
+std::filesystem::path temp_path(std::filesystem::path path)
+{
+    path += ".tmp" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+    return path;
+}
+
+}; // anonymous
+
+namespace repo
+{
+
+artifact_store_t::artifact_store_t(std::filesystem::path const& store_dir)
+    : m_store_dir(store_dir)
+{
+}
+
+bool artifact_store_t::fetch(
+    std::string const& repository,
+    std::string const& commit_id,
+    std::string const& platform,
+    std::string const& build_key,
+    std::filesystem::path const& tgt) const
+{
+    std::ifstream ifs(m_store_dir / repository / commit_id / platform / build_key, std::ios::binary);
+    if (!ifs.is_open())
+    {
+        return false;
+    }
+    std::filesystem::path const temp = temp_path(tgt);
+    try
+    {
+        unpack(ifs, temp);
+    }
+    catch (...)
+    {
+        std::filesystem::remove_all(temp);
+        throw;
+    }
+    std::filesystem::remove_all(tgt);
+    std::filesystem::rename(temp, tgt);
+    return true;
+}
+
+void artifact_store_t::publish(
+    std::string const& repository,
+    std::string const& commit_id,
+    std::string const& platform,
+    std::string const& build_key,
+    std::filesystem::path const& tgt) const
+{
+    std::filesystem::path const dir = m_store_dir / repository / commit_id / platform;
+    std::filesystem::path const artifact = dir / build_key;
+    if (std::filesystem::exists(artifact))
+    {
+        return;
+    }
+    // write aside first, so other agents never fetch a partial artifact
+    std::filesystem::create_directories(dir);
+    std::filesystem::path const temp = temp_path(artifact);
+    {
+        std::ofstream ofs(temp, std::ios::binary | std::ios::trunc);
+        pack(tgt, ofs);
+        if (!ofs)
+        {
+            ofs.close();
+            std::filesystem::remove(temp);
+            throw std::runtime_error("Cannot write '" + temp.string() + "'");
+        }
+    }
+    std::error_code ec;
+    std::filesystem::rename(temp, artifact, ec);
+    if (ec)
+    {
+        // another agent published the same artifact in the meantime
+        std::filesystem::remove(temp);
+    }
+}
+
+}; // namespace repo
@@ -0,0 +1,35 @@
+#ifndef REPO_ARTIFACT_STORE
+#define REPO_ARTIFACT_STORE
+
+#include <filesystem>
+#include <string>
+
+namespace repo
+{
+
+// Store of prebuilt 'tgt' outputs shared between build agents, e.g. on a
+// network share. Artifacts are kept as one archive per repository, commit,
+// platform and build key, and are streamed in and out of the store.
+class artifact_store_t
+{
+public:
+    explicit artifact_store_t(std::filesystem::path const& store_dir);
+    bool fetch(
+        std::string const& repository,
+        std::string const& commit_id,
+        std::string const& platform,
+        std::string const& build_key,
+        std::filesystem::path const& tgt) const;
+    void publish(
+        std::string const& repository,
+        std::string const& commit_id,
+        std::string const& platform,
+        std::string const& build_key,
+        std::filesystem::path const& tgt) const;
+private:
+    std::filesystem::path m_store_dir;
+};
+
+}; // namespace repo
+
+#endif // REPO_ARTIFACT_STORE
@@ -0,0 +1,142 @@
+#include "build_cache.h"
+#include "build_output.h"
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <chrono>
+#include <memory>
+#include "git_util.h"
+
+namespace // anonymous
+{
+
+char const build_key_filename[] = ".build_key";
+
+}; // anonymous
+
+namespace repo
+{
+
+build_cache_t::build_cache_t(std::filesystem::path const& cache_dir, std::string const& toolchain)
+    : m_cache_dir(cache_dir)
+    , m_toolchain(toolchain)
+{
+}
+
+std::string build_cache_t::key(std::string const& tree_id, std::vector<std::string> const& dependency_tree_ids) const
+{
+    std::stringstream ss;
+    ss << "tree " << tree_id << '\n';
+    for (std::string const& dependency_tree_id : dependency_tree_ids)
+    {
+        ss << "dependency " << dependency_tree_id << '\n';
+    }
+    ss << "toolchain " << m_toolchain << '\n';
+    std::string const data = ss.str();
+    git_oid oid;
+    check(git_odb_hash(&oid, data.data(), data.size(), GIT_OBJ_BLOB));
+    return to_string(oid);
+}
+
+bool build_cache_t::restore(std::string const& key, std::filesystem::path const& tgt) const
+{
+    std::filesystem::path const entry = m_cache_dir / key;
+    if (!std::filesystem::is_directory(entry))
+    {
+        return false;
+    }
+    std::filesystem::remove_all(tgt);
+    std::filesystem::copy(entry, tgt, std::filesystem::copy_options::recursive);
+    return true;
+}
+
+void build_cache_t::store(std::string const& key, std::filesystem::path const& tgt) const
+{
+    std::filesystem::path const entry = m_cache_dir / key;
+    if (std::filesystem::exists(entry))
+    {
+        return;
+    }
+    // copy aside first, so a concurrent restore never sees a partial entry
+    std::filesystem::create_directories(m_cache_dir);
+    std::filesystem::path temp = entry;
+    temp += ".tmp" + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count());
+    std::filesystem::copy(tgt, temp, std::filesystem::copy_options::recursive);
+    std::error_code ec;
+    std::filesystem::rename(temp, entry, ec);
+    if (ec)
+    {
+        // another build stored the same key in the meantime
+        std::filesystem::remove_all(temp);
+    }
+}
+
+std::string read_build_key(std::filesystem::path const& tgt)
+{
+    std::ifstream ifs(tgt / build_key_filename);
+    std::string key;
+    std::getline(ifs, key);
+    return key;
+}
+
+void write_build_key(std::filesystem::path const& tgt, std::string const& key)
+{
+    std::ofstream ofs(tgt / build_key_filename, std::ios::trunc);
+    ofs << key << std::endl;
+}
+
+void remove_build_key(std::filesystem::path const& tgt)
+{
+    std::error_code ec;
+    std::filesystem::remove(tgt / build_key_filename, ec);
+    if (ec)
+    {
+        throw std::runtime_error("Cannot remove the build key of '" + tgt.string() + "': " + ec.message());
+    }
+}
+
+std::string get_clean_tree_id(std::filesystem::path const& repo_path)
+{
+    git_repository *repo = NULL;
+    std::unique_ptr<git_repository, decltype(&::git_repository_free)>
+        repo_guard(repo, &::git_repository_free);
+    check(git_repository_open(&repo, repo_path.string().c_str()));
+    repo_guard.reset(repo);
+    git_status_options status_options = GIT_STATUS_OPTIONS_INIT;
+    status_options.show = GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
+    status_options.flags = GIT_STATUS_OPT_INCLUDE_UNTRACKED;
+    git_status_list *status = NULL;
+    std::unique_ptr<git_status_list, decltype(&::git_status_list_free)>
+        status_guard(status, &::git_status_list_free);
+    check(git_status_list_new(&status, repo, &status_options));
+    status_guard.reset(status);
+    for (size_t i = 0, n = git_status_list_entrycount(status); i < n; ++i)
+    {
+        git_status_entry const* entry = git_status_byindex(status, i);
+        git_diff_delta const* delta = entry->index_to_workdir ? entry->index_to_workdir : entry->head_to_index;
+        if (!delta || !is_build_output(delta->old_file.path))
+        {
+            return std::string();
+        }
+    }
+    git_object *tree = NULL;
+    std::unique_ptr<git_object, decltype(&::git_object_free)>
+        tree_guard(tree, &::git_object_free);
+    check(git_revparse_single(&tree, repo, "HEAD^{tree}"));
+    tree_guard.reset(tree);
+    return to_string(*git_object_id(tree));
+}
+
+std::string get_head_commit_id(std::filesystem::path const& repo_path)
+{
+    git_repository *repo = NULL;
+    std::unique_ptr<git_repository, decltype(&::git_repository_free)>
+        repo_guard(repo, &::git_repository_free);
+    check(git_repository_open(&repo, repo_path.string().c_str()));
+    repo_guard.reset(repo);
+    git_oid oid;
+    check(git_reference_name_to_id(&oid, repo, "HEAD"));
+    return to_string(oid);
+}
+
+}; // namespace repo
@@ -0,0 +1,41 @@
+#ifndef REPO_BUILD_CACHE
+#define REPO_BUILD_CACHE
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace repo
+{
+
+// Cache of 'tgt' build outputs.
+// An entry is keyed by the tree checked out in a repository, the trees of
+// the repositories it depends on, and the toolchain that built it.
+class build_cache_t
+{
+public:
+    build_cache_t(std::filesystem::path const& cache_dir, std::string const& toolchain);
+    std::string key(std::string const& tree_id, std::vector<std::string> const& dependency_tree_ids) const;
+    bool restore(std::string const& key, std::filesystem::path const& tgt) const;
+    void store(std::string const& key, std::filesystem::path const& tgt) const;
+private:
+    std::filesystem::path m_cache_dir;
+    std::string m_toolchain;
+};
+
+// Returns the key with which 'tgt' was built or restored, empty if unknown.
+std::string read_build_key(std::filesystem::path const& tgt);
+void write_build_key(std::filesystem::path const& tgt, std::string const& key);
+// Forgets the key of 'tgt', before it is rebuilt, so that a 'tgt' which a
+// build changed, or left half done, never passes for the key it had
+void remove_build_key(std::filesystem::path const& tgt);
+
+// Returns the tree id of HEAD, or an empty string when the working tree
+// has local changes and therefore cannot be identified by a tree id.
+std::string get_clean_tree_id(std::filesystem::path const& repo_path);
+
+std::string get_head_commit_id(std::filesystem::path const& repo_path);
+
+}; // namespace repo
+
+#endif // REPO_BUILD_CACHE
@@ -0,0 +1,19 @@
+#ifndef REPO_BUILD_OUTPUT
+#define REPO_BUILD_OUTPUT
+
+#include <string>
+
+namespace repo
+{
+
+// True for paths, relative to the repository, in the 'tgt' and 'obj'
+// build output directories, which never count as local changes
+inline bool is_build_output(char const* path)
+{
+    std::string const p(path ? path : "");
+    return (p.compare(0, 4, "tgt/") == 0) || (p.compare(0, 4, "obj/") == 0);
+}
+
+}; // namespace repo
+
+#endif // REPO_BUILD_OUTPUT
@@ -0,0 +1,183 @@
+#include "daemon.h"
+#include <exception>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace // anonymous
+{
+
+unsigned const max_accept_failures = 10;
+// a client which connects but does not ask, or does not read the answer,
+// holds up the stop of the daemon no longer than this
+std::chrono::seconds const client_timeout(10);
+
+}; // anonymous
+
+namespace repo
+{
+
+sync_daemon_t::sync_daemon_t(sync_t sync, status_t status, std::chrono::seconds period)
+    : m_sync(sync)
+    , m_status(status)
+    , m_period(period)
+    , m_stop(false)
+    , m_requested(true)
+    , m_running(false)
+    , m_started(0)
+    , m_completed(0)
+    , m_serving(0)
+{
+}
+
+void sync_daemon_t::run(std::filesystem::path const& socket_path)
+{
+    m_socket_path = socket_path;
+    local_socket_t listener = local_socket_t::listen(socket_path);
+    std::thread syncer(&sync_daemon_t::sync_loop, this);
+    // a client which resets its connection, or an interrupted accept, does
+    // not stop the daemon; only a listener which keeps failing does
+    unsigned failures = 0;
+    std::exception_ptr error;
+    for (;;)
+    {
+        try
+        {
+            local_socket_t connection = listener.accept();
+            failures = 0;
+            std::lock_guard<std::mutex> lock(m_mutex);
+            if (m_stop)
+            {
+                break;
+            }
+            std::thread(&sync_daemon_t::serve, this, std::move(connection)).detach();
+            ++m_serving;
+        }
+        catch (std::exception const&)
+        {
+            if (++failures >= max_accept_failures)
+            {
+                error = std::current_exception();
+                break;
+            }
+        }
+    }
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_stop = true;
+        m_changed.notify_all();
+        m_changed.wait(lock, [this] { return m_serving == 0; });
+    }
+    syncer.join();
+    std::error_code ec;
+    std::filesystem::remove(socket_path, ec);
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+void sync_daemon_t::request(std::filesystem::path const& socket_path, std::string const& command, std::ostream& os)
+{
+    local_socket_t connection = local_socket_t::connect(socket_path);
+    connection.write(command + "\n");
+    std::string line;
+    while (connection.read_line(line))
+    {
+        os << line << std::endl;
+    }
+}
+
+void sync_daemon_t::sync_loop()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    for (;;)
+    {
+        m_changed.wait_for(lock, m_period, [this] { return m_stop || m_requested; });
+        if (m_stop)
+        {
+            break;
+        }
+        m_requested = false;
+        m_running = true;
+        ++m_started;
+        lock.unlock();
+        std::string outcome("done");
+        try
+        {
+            m_sync();
+        }
+        catch (std::exception const& e)
+        {
+            outcome = std::string("failed: ") + e.what();
+        }
+        lock.lock();
+        m_running = false;
+        ++m_completed;
+        m_outcome = outcome;
+        m_changed.notify_all();
+    }
+}
+
+std::string sync_daemon_t::wait_for_sync()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    // a running sync may have started before the request, but does not miss
+    // much; joining it is what makes the answer almost instant
+    unsigned const target = m_running ? m_started : m_started + 1;
+    if (!m_running)
+    {
+        m_requested = true;
+        m_changed.notify_all();
+    }
+    m_changed.wait(lock, [&] { return m_stop || (m_completed >= target); });
+    return (m_completed >= target) ? m_outcome : std::string("stopped");
+}
+
+void sync_daemon_t::serve(local_socket_t connection)
+{
+    try
+    {
+        connection.set_timeout(client_timeout);
+        std::string command;
+        if (!connection.read_line(command))
+        {
+            // the client went away before asking
+        }
+        else if (command == "sync")
+        {
+            connection.write(wait_for_sync() + "\n");
+        }
+        else if (command == "status")
+        {
+            std::stringstream ss;
+            m_status(ss);
+            connection.write(ss.str());
+        }
+        else if (command == "stop")
+        {
+            connection.write("stopping\n");
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+                m_changed.notify_all();
+            }
+            // wakes the accepting thread, which then sees the stop
+            local_socket_t::connect(m_socket_path);
+        }
+        else
+        {
+            connection.write("unknown request '" + command + "'\n");
+        }
+    }
+    catch (std::exception const&)
+    {
+        // the client went away
+    }
+    // notified under the lock, since run() returns once it is released
+    std::lock_guard<std::mutex> lock(m_mutex);
+    --m_serving;
+    m_changed.notify_all();
+}
+
+}; // namespace repo
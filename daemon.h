@@ -0,0 +1,54 @@
+#ifndef REPO_DAEMON
+#define REPO_DAEMON
+
+#include "local_socket.h"
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+namespace repo
+{
+
+// Syncs in the background, every period and whenever a client asks for it,
+// and serves the requests of clients at a local socket:
+//   sync    waits for the running sync, or else for a new one, and
+//           answers its outcome
+//   status  answers the status of the repositories
+//   stop    stops the daemon
+class sync_daemon_t
+{
+public:
+    using sync_t = std::function<void()>;
+    using status_t = std::function<void(std::ostream&)>;
+    sync_daemon_t(sync_t sync, status_t status, std::chrono::seconds period);
+    // Serves until a client asks to stop
+    void run(std::filesystem::path const& socket_path);
+    // Sends a request to the daemon at 'socket_path' and writes its answer to 'os'
+    static void request(std::filesystem::path const& socket_path, std::string const& command, std::ostream& os);
+private:
+    void sync_loop();
+    std::string wait_for_sync();
+    void serve(local_socket_t connection);
+    sync_t m_sync;
+    status_t m_status;
+    std::chrono::seconds m_period;
+    std::filesystem::path m_socket_path;
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    bool m_stop;
+    bool m_requested;
+    bool m_running;
+    unsigned m_started;
+    unsigned m_completed;
+    // connections being served, each by a detached thread
+    unsigned m_serving;
+    std::string m_outcome;
+};
+
+}; // namespace repo
+
+#endif // REPO_DAEMON
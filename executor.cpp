@@ -0,0 +1,48 @@
+#include "executor.h"
+#include <stdexcept>
+
+namespace // anonymous
+{
+
+// The token of a job, which make in the job uses for its first job
+class token_t
+{
+public:
+    explicit token_t(repo::jobserver_t& jobserver)
+        : m_jobserver(jobserver)
+    {
+        m_jobserver.acquire();
+    }
+    ~token_t()
+    {
+        m_jobserver.release();
+    }
+private:
+    repo::jobserver_t& m_jobserver;
+};
+
+}; // anonymous
+
+namespace repo
+{
+
+executor_t::executor_t(unsigned tokens)
+    : m_jobserver(tokens)
+{
+}
+
+job_result_t executor_t::run(job_t const& job)
+{
+    token_t token(m_jobserver);
+    std::filesystem::create_directories(job.m_stdout_path.parent_path());
+    std::filesystem::create_directories(job.m_stderr_path.parent_path());
+    std::vector<std::string> environment = job.m_environment;
+    environment.push_back("MAKEFLAGS=" + m_jobserver.makeflags());
+    std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+    job_result_t result;
+    result.m_exit_status = spawn_and_wait(job.m_args, job.m_working_dir, job.m_stdout_path, job.m_stderr_path, environment);
+    result.m_duration = std::chrono::steady_clock::now() - start;
+    return result;
+}
+
+}; // namespace repo
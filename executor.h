@@ -0,0 +1,44 @@
+#ifndef REPO_EXECUTOR
+#define REPO_EXECUTOR
+
+#include "platform_specific.h"
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace repo
+{
+
+struct job_t
+{
+    std::vector<std::string> m_args;
+    std::filesystem::path m_working_dir;
+    std::filesystem::path m_stdout_path;
+    std::filesystem::path m_stderr_path;
+    // NAME=value variables in addition to those of this process
+    std::vector<std::string> m_environment;
+};
+
+struct job_result_t
+{
+    int m_exit_status;
+    std::chrono::steady_clock::duration m_duration;
+};
+
+// Runs jobs as child processes, without a shell and without changing the
+// current path of this process, so it may be called from several threads.
+// A jobserver limits the number of jobs which run at the same time, both
+// the jobs themselves and those which make starts in them.
+class executor_t
+{
+public:
+    explicit executor_t(unsigned tokens);
+    job_result_t run(job_t const& job);
+private:
+    jobserver_t m_jobserver;
+};
+
+}; // namespace repo
+
+#endif // REPO_EXECUTOR
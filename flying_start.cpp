@@ -1,16 +1,45 @@
 #include "repo/repo.h"
 #include "platform_specific.h"
+#include "build_cache.h"
+#include "artifact_store.h"
+#include "executor.h"
+#include "parallel.h"
+#include "maintenance.h"
+#include "memory_budget.h"
+#include "sync_summary.h"
+#include "sync_history.h"
+#include "status.h"
+#include "verify.h"
+#include "daemon.h"
+#include "repo_options.h"
 #include <iostream>
 #include <string>
 #include <filesystem>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <exception>
+#include <condition_variable>
+#include <cstdlib>
 
 // projects and/or products are called 'procts'
 #define PROCTS "procts"
 #define FLYING_START "flying_start"
 
+#if REPO_ARCHIVE_TYPE == REPO_ARCHIVE_USB
+using archive_repo_ref_t = repo::gitfile_repo_ref_t;
+#elif REPO_ARCHIVE_TYPE == REPO_ARCHIVE_GITHUB_HTTPS
+using archive_repo_ref_t = repo::githttps_repo_ref_t;
+#elif REPO_ARCHIVE_TYPE == REPO_ARCHIVE_GITHUB_SSH
+using archive_repo_ref_t = repo::gitssh_repo_ref_t;
+#endif
+
 namespace // anonymous
 {
 
+// resolved bases kept per fetched pack, without a memory budget
+size_t const default_index_cache_size = size_t(256) << 20;
+
 std::filesystem::path get_path(int argc, char const* argv[])
 {
     if (argc < 1)
@@ -46,6 +75,189 @@ std::filesystem::path get_path(int argc, char const* argv[])
     return path;
 }
 
+struct options_t
+{
+    std::filesystem::path m_build_cache_dir;
+    std::filesystem::path m_artifact_store_dir;
+    unsigned m_build_jobs = std::thread::hardware_concurrency();
+    unsigned m_sync_jobs = 4;
+    bool m_maintenance = false;
+    size_t m_memory_budget = 0;
+    bool m_partial_clone = false;
+    // syncs which read from the same slow device at once, 0 for no limit
+    unsigned m_archive_readers = 1;
+    // threads which resolve the deltas of a fetched pack, 0 for libgit2's
+    // own indexer, and the resolved bases each keeps, 0 for the share of
+    // the memory budget, or else default_index_cache_size
+    unsigned m_index_threads = std::thread::hardware_concurrency();
+    size_t m_index_cache_size = 0;
+    enum class status_t
+    {
+        none,
+        table,
+        json
+    } m_status = status_t::none;
+    enum class verify_t
+    {
+        none,
+        report,
+        // checks out corrupt files again
+        repair,
+        // checks out all files which do not match the index again
+        repair_all
+    } m_verify = verify_t::none;
+    // working trees of further branches of a repository, in a directory
+    // next to it, which share the object database of its clone
+    struct worktree_t
+    {
+        std::string m_local;
+        std::string m_branch;
+        std::string m_dirname;
+    };
+    std::vector<worktree_t> m_worktrees;
+    // syncs in the background every period, when not zero
+    std::chrono::seconds m_daemon_period = std::chrono::seconds::zero();
+    std::string m_request;
+};
+
+bool get_option_value(std::string const& arg, std::string const& name, std::string& value)
+{
+    if (arg.compare(0, name.size(), name) != 0)
+    {
+        return false;
+    }
+    value = arg.substr(name.size());
+    return true;
+}
+
+options_t parse_options(std::filesystem::path const& path, int argc, char const* argv[])
+{
+    options_t options;
+    options.m_build_cache_dir = path / "." FLYING_START / "build_cache";
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string const arg(argv[i]);
+        std::string value;
+        if (arg == "--maintenance")
+        {
+            options.m_maintenance = true;
+        }
+        else if (arg == "--status")
+        {
+            options.m_status = options_t::status_t::table;
+        }
+        else if (arg == "--status=json")
+        {
+            options.m_status = options_t::status_t::json;
+        }
+        else if (arg == "--verify")
+        {
+            options.m_verify = options_t::verify_t::report;
+        }
+        else if (arg == "--verify=repair")
+        {
+            options.m_verify = options_t::verify_t::repair;
+        }
+        else if (arg == "--verify=repair-all")
+        {
+            options.m_verify = options_t::verify_t::repair_all;
+        }
+        else if (arg == "--daemon")
+        {
+            options.m_daemon_period = std::chrono::minutes(10);
+        }
+        else if (get_option_value(arg, "--daemon=", value))
+        {
+            // in seconds
+            options.m_daemon_period = std::chrono::seconds(std::max(std::stoul(value), 1ul));
+        }
+        else if (get_option_value(arg, "--request=", value))
+        {
+            options.m_request = value;
+        }
+        else if (arg == "--partial-clone")
+        {
+#if REPO_ARCHIVE_TYPE == REPO_ARCHIVE_USB
+            options.m_partial_clone = true;
+#else
+            std::cout << "Warning: partial clones need a file archive, cloning fully" << std::endl;
+#endif
+        }
+        else if (get_option_value(arg, "--worktree=", value))
+        {
+            // <local name>:<branch>, checked out into <local name>@<branch>
+            size_t const colon = value.find(':');
+            if ((colon == std::string::npos) || (colon == 0) || (colon + 1 == value.size()))
+            {
+                throw std::runtime_error("Option '" + arg + "' is not --worktree=<local name>:<branch>");
+            }
+            options_t::worktree_t worktree{ value.substr(0, colon), value.substr(colon + 1) };
+            worktree.m_dirname = worktree.m_local + '@' + worktree.m_branch;
+            std::replace(worktree.m_dirname.begin(), worktree.m_dirname.end(), '/', '_');
+            options.m_worktrees.push_back(worktree);
+        }
+        else if (get_option_value(arg, "--build-cache=", value))
+        {
+            options.m_build_cache_dir = value;
+        }
+        else if (get_option_value(arg, "--artifact-store=", value))
+        {
+            options.m_artifact_store_dir = value;
+        }
+        else if (get_option_value(arg, "--build-jobs=", value))
+        {
+            options.m_build_jobs = std::stoul(value);
+        }
+        else if (get_option_value(arg, "--sync-jobs=", value))
+        {
+            options.m_sync_jobs = std::stoul(value);
+        }
+        else if (get_option_value(arg, "--archive-readers=", value))
+        {
+            options.m_archive_readers = std::stoul(value);
+        }
+        else if (get_option_value(arg, "--memory-budget=", value))
+        {
+            // in MiB
+            options.m_memory_budget = size_t(std::stoull(value)) << 20;
+        }
+        else if (get_option_value(arg, "--index-threads=", value))
+        {
+            options.m_index_threads = std::stoul(value);
+        }
+        else if (get_option_value(arg, "--index-cache=", value))
+        {
+            // in MiB
+            options.m_index_cache_size = size_t(std::stoull(value)) << 20;
+        }
+        else
+        {
+            throw std::runtime_error("Unknown option '" + arg + "'");
+        }
+    }
+    return options;
+}
+
+// identifies the compiler which builds the 'tgt' outputs
+std::string get_toolchain()
+{
+    std::string toolchain(TARGET_DIR);
+#ifdef _WIN32
+#pragma warning( push )
+#pragma warning( disable : 4996)
+#endif
+    char const* tools_version = getenv("VCToolsVersion");
+#ifdef _WIN32
+#pragma warning( pop )
+#endif
+    if (tools_version)
+    {
+        toolchain += ' ';
+        toolchain += tools_version;
+    }
+    return toolchain;
+}
+
 void ask_commit_user(std::ostream& os, std::istream& is, std::string& commit_user)
 {
     os << "For identification of your commits," << std::endl;
@@ -65,7 +277,197 @@ void ask_user_pwd(std::ostream& os, std::istream& is, std::string& user, std::st
     os << std::endl;
 }
 
-void cppmake(std::filesystem::path path, std::string const& stem)
+bool fetch_artifact(
+    repo::artifact_store_t const& artifact_store,
+    repo::repository_t const& repository,
+    std::string const& commit_id,
+    std::string const& key,
+    std::filesystem::path const& tgt)
+{
+    try
+    {
+        return artifact_store.fetch(repository.m_remote, commit_id, TARGET_DIR, key, tgt);
+    }
+    catch (std::exception const& e)
+    {
+        std::cout << "Warning: cannot fetch '" << repository.m_local << "' from the artifact store: " << e.what() << std::endl;
+        return false;
+    }
+}
+
+void publish_artifact(
+    repo::artifact_store_t const& artifact_store,
+    repo::repository_t const& repository,
+    std::string const& commit_id,
+    std::string const& key,
+    std::filesystem::path const& tgt)
+{
+    try
+    {
+        artifact_store.publish(repository.m_remote, commit_id, TARGET_DIR, key, tgt);
+    }
+    catch (std::exception const& e)
+    {
+        std::cout << "Warning: cannot publish '" << repository.m_local << "' to the artifact store: " << e.what() << std::endl;
+    }
+}
+
+// Keeps the packs and refs of the synced repositories in shape, on a
+// thread of background priority. Runs after the builds, because
+// repacking deletes the packs which a build may be reading.
+void maintain_all(std::vector<repo::repository_t> const& repositories, std::filesystem::path const& path)
+{
+    std::thread thread([&]()
+    {
+        repo::set_background_priority();
+        for (repo::repository_t const& repository : repositories)
+        {
+            try
+            {
+                repo::maintain(path / repository.m_local, repo::maintenance_thresholds_t(), std::cout);
+            }
+            catch (std::exception const& e)
+            {
+                std::cout << "Warning: maintenance of '" << repository.m_local << "' failed: " << e.what() << std::endl;
+            }
+        }
+    });
+    thread.join();
+}
+
+// Reads the statuses of 'submodules' in parallel, then those of their
+// submodules, level by level, and returns for each submodule its status
+// followed by those of its submodules, depth first
+std::vector<std::vector<repo::status_t>> get_submodule_statuses(std::vector<repo::status_t::submodule_t> const& submodules)
+{
+    std::vector<repo::status_t> statuses(submodules.size());
+    repo::parallel_for_each(submodules.begin(), submodules.end(), std::thread::hardware_concurrency(),
+        [&](repo::status_t::submodule_t const& submodule)
+    {
+        statuses[&submodule - submodules.data()] = repo::get_status(submodule.m_path, nullptr, submodule.m_commit.c_str());
+    });
+    std::vector<repo::status_t::submodule_t> nested;
+    for (repo::status_t const& status : statuses)
+    {
+        nested.insert(nested.end(), status.m_submodules.begin(), status.m_submodules.end());
+    }
+    std::vector<std::vector<repo::status_t>> const nested_statuses = nested.empty() ?
+        std::vector<std::vector<repo::status_t>>() : get_submodule_statuses(nested);
+    std::vector<std::vector<repo::status_t>> trees(statuses.size());
+    std::vector<std::vector<repo::status_t>>::const_iterator pnested_status = nested_statuses.begin();
+    for (size_t i = 0; i < statuses.size(); ++i)
+    {
+        trees[i].push_back(statuses[i]);
+        for (size_t j = 0; j < statuses[i].m_submodules.size(); ++j, ++pnested_status)
+        {
+            trees[i].insert(trees[i].end(), pnested_status->begin(), pnested_status->end());
+        }
+    }
+    return trees;
+}
+
+// Reads the status of all repositories, against the branch or commit of
+// 'repo_ref' which a sync would check out, and then of all their
+// submodules, each level on as many threads as there are cores
+void print_status(
+    std::ostream& os,
+    std::vector<repo::repository_t> const& repositories,
+    repo::repo_ref_t const& repo_ref,
+    options_t::status_t format)
+{
+    std::vector<repo::status_t> statuses(repositories.size());
+    repo::parallel_for_each(repositories.begin(), repositories.end(), std::thread::hardware_concurrency(),
+        [&](repo::repository_t const& repository)
+    {
+        statuses[&repository - repositories.data()] = repo::get_status(repository.m_local, repo_ref.m_branch, repo_ref.m_commit_sha);
+    });
+    std::vector<repo::status_t::submodule_t> submodules;
+    for (repo::status_t const& status : statuses)
+    {
+        submodules.insert(submodules.end(), status.m_submodules.begin(), status.m_submodules.end());
+    }
+    std::vector<std::vector<repo::status_t>> const submodule_statuses = get_submodule_statuses(submodules);
+    // list each repository followed by its submodules
+    std::vector<repo::status_t> all;
+    std::vector<std::vector<repo::status_t>>::const_iterator psubmodule_status = submodule_statuses.begin();
+    for (repo::status_t const& status : statuses)
+    {
+        all.push_back(status);
+        for (size_t i = 0; i < status.m_submodules.size(); ++i, ++psubmodule_status)
+        {
+            all.insert(all.end(), psubmodule_status->begin(), psubmodule_status->end());
+        }
+    }
+    if (format == options_t::status_t::json)
+    {
+        repo::print_status_json(os, all);
+    }
+    else
+    {
+        repo::print_status_table(os, all);
+    }
+}
+
+// Verifies, and with 'repair' repairs, the working trees of all
+// repositories and of their submodules, one after the other, each on as
+// many threads as there are cores
+void verify_all(std::ostream& os, std::vector<repo::repository_t> const& repositories, repo::repair_t repair)
+{
+    unsigned const jobs = std::max(std::thread::hardware_concurrency(), 1u);
+    std::vector<repo::verify_result_t> results;
+    for (repo::repository_t const& repository : repositories)
+    {
+        results.push_back(repo::verify(repository.m_local, jobs, repair));
+        for (std::filesystem::path const& submodule_path : repo::get_submodule_paths(repository.m_local))
+        {
+            results.push_back(repo::verify(submodule_path, jobs, repair));
+        }
+    }
+    repo::print_verify_results(os, results);
+}
+
+struct build_context_t
+{
+    repo::build_cache_t const& m_build_cache;
+    repo::artifact_store_t const* m_artifact_store;
+    repo::executor_t& m_executor;
+    std::filesystem::path m_log_dir;
+    std::vector<std::string> m_tree_ids;
+};
+
+bool make(repo::executor_t& executor, std::filesystem::path const& repo_dir, std::string const& stem, std::filesystem::path const& log_dir)
+{
+    repo::job_t job;
+    job.m_args = repo::get_make_command(repo_dir);
+    job.m_working_dir = repo_dir;
+    job.m_stdout_path = log_dir / (stem + ".out.log");
+    job.m_stderr_path = log_dir / (stem + ".err.log");
+    repo::job_result_t result;
+    try
+    {
+        result = executor.run(job);
+    }
+    catch (std::exception const& e)
+    {
+        // e.g. a repository without a make script, which fails its own build only
+        std::cout << "Building repository '" << stem << "' failed: " << e.what() << std::endl;
+        return false;
+    }
+    double const seconds = std::chrono::duration<double>(result.m_duration).count();
+    if (result.m_exit_status != 0)
+    {
+        std::cout << "Building repository '" << stem << "' failed with exit status " << result.m_exit_status
+            << " after " << seconds << "s, see " << job.m_stderr_path << std::endl;
+        return false;
+    }
+    std::cout << "Built repository '" << stem << "' in " << seconds << "s" << std::endl;
+    return true;
+}
+
+void cppmake(
+    std::filesystem::path path,
+    repo::repository_t const& repository,
+    build_context_t& context)
 {
     /* this is fake!
        this is to be replaced by a hardcoded compile script which compiles:
@@ -87,18 +489,58 @@ void cppmake(std::filesystem::path path, std::string const& stem)
        And with some additional effort we can get rid of the microsoft
        visual studio solution and project files, as we can generate them.
        */
+    std::string const stem = repository.m_local;
     path /= stem;
-    std::filesystem::current_path(path);
-	std::filesystem::path tgt = path / "tgt";
-	if (std::filesystem::exists(tgt))
-	{
-		std::cout << "Skip building repository '" << stem << "', because a 'tgt' subdirectory has been spotted." << std::endl;
-	}
-	else
-	{
-		std::cout << "Build stem repository '" << stem << "'" << std::endl;
-		std::system("make.cmd");
-	}
+    std::filesystem::path tgt = path / "tgt";
+    // the lock of syncs, so that another process neither checks out the
+    // sources nor replaces 'tgt' while this one builds
+    repo::file_lock_t build_lock(repo::get_lock_path(path));
+    if (!build_lock.try_lock())
+    {
+        std::cout << "Waiting for another process using '" << stem << "'..." << std::endl;
+        build_lock.lock();
+    }
+    repo::build_cache_t const& build_cache = context.m_build_cache;
+    repo::artifact_store_t const* artifact_store = context.m_artifact_store;
+    std::vector<std::string>& tree_ids = context.m_tree_ids;
+    // the repositories listed before this one are the ones it may depend on
+    bool const dependencies_clean = std::find(tree_ids.begin(), tree_ids.end(), std::string()) == tree_ids.end();
+    std::string const tree_id = repo::get_clean_tree_id(path);
+    std::string const key = (!tree_id.empty() && dependencies_clean) ? build_cache.key(tree_id, tree_ids) : std::string();
+    tree_ids.push_back(tree_id);
+    if (key.empty())
+    {
+        std::cout << "Build stem repository '" << stem << "' (local changes, build cache bypassed)" << std::endl;
+        repo::remove_build_key(tgt);
+        make(context.m_executor, path, stem, context.m_log_dir);
+    }
+    else if (std::filesystem::exists(tgt) && (repo::read_build_key(tgt) == key))
+    {
+        std::cout << "Skip building repository '" << stem << "', because its 'tgt' subdirectory is up to date." << std::endl;
+    }
+    else if (build_cache.restore(key, tgt))
+    {
+        std::cout << "Restored repository '" << stem << "' from the build cache" << std::endl;
+    }
+    else if (artifact_store && fetch_artifact(*artifact_store, repository, repo::get_head_commit_id(path), key, tgt))
+    {
+        std::cout << "Fetched repository '" << stem << "' from the artifact store" << std::endl;
+        build_cache.store(key, tgt);
+    }
+    else
+    {
+        std::cout << "Build stem repository '" << stem << "'" << std::endl;
+        repo::remove_build_key(tgt);
+        if (make(context.m_executor, path, stem, context.m_log_dir) && std::filesystem::exists(tgt))
+        {
+            repo::write_build_key(tgt, key);
+            build_cache.store(key, tgt);
+            if (artifact_store)
+            {
+                publish_artifact(*artifact_store, repository, repo::get_head_commit_id(path), key, tgt);
+            }
+        }
+    }
 }
 
 void flying_start(
@@ -106,11 +548,12 @@ void flying_start(
     repo::gitfile_repo_ref_t& git_repo_ref,
     std::filesystem::path const& path,
     char const* remote_name,
-    char const* local_name)
+    char const* local_name,
+    char const* dirname = nullptr)
 {
     git_repo_ref.m_remote_name = remote_name;
     git_repo_ref.m_local_name = local_name;
-    repo.get(git_repo_ref, path.string().c_str(), nullptr);
+    repo.get(git_repo_ref, path.string().c_str(), dirname);
 }
 
 void flying_start(
@@ -118,11 +561,12 @@ void flying_start(
     repo::githttps_repo_ref_t& git_repo_ref,
     std::filesystem::path const& path,
     char const* remote_name,
-    char const* local_name)
+    char const* local_name,
+    char const* dirname = nullptr)
 {
     git_repo_ref.m_remote_name = remote_name;
     git_repo_ref.m_local_name = local_name;
-    repo.get(git_repo_ref, path.string().c_str(), nullptr);
+    repo.get(git_repo_ref, path.string().c_str(), dirname);
 }
 
 void flying_start(
@@ -130,12 +574,131 @@ void flying_start(
     repo::gitssh_repo_ref_t& git_repo_ref, 
     std::filesystem::path const& path,
     char const* remote_name,
-    char const* local_name)
+    char const* local_name,
+    char const* dirname = nullptr)
 {
     git_repo_ref.m_gituser = repo::get_username();
     git_repo_ref.m_remote_name = remote_name;
     git_repo_ref.m_local_name = local_name;
-    repo.get(git_repo_ref, path.string().c_str(), nullptr);
+    repo.get(git_repo_ref, path.string().c_str(), dirname);
+}
+
+void sync_and_build(
+    repo::repo_t& repo,
+    archive_repo_ref_t const& git_repo_ref,
+    std::vector<repo::repository_t> const& repositories,
+    std::filesystem::path const& path,
+    options_t const& options,
+    repo::executor_t& executor)
+{
+    // fetching, and resolving the deltas of what was fetched, overlaps
+    // between repositories, and the deltas of each pack are resolved on
+    // several threads; the syncs which hold up the builds most
+    // start first, and each build starts once its repository and all listed
+    // before it have synced, while the other syncs go on
+    std::mutex synced_mutex;
+    std::condition_variable synced_changed;
+    std::vector<bool> synced(repositories.size(), false);
+    bool syncs_done = false;
+    std::exception_ptr sync_error;
+    std::thread syncer([&]()
+    {
+        try
+        {
+            repo::sync_history_t sync_history(path / "." FLYING_START / "sync_history");
+            std::vector<size_t> const order = sync_history.order(repositories, path);
+            repo::sync_summary_t sync_summary(repositories.size());
+            repo::parallel_for_each(order.begin(), order.end(), options.m_sync_jobs,
+                [&](size_t index)
+            {
+                repo::repository_t const& repository = repositories[index];
+                auto repository_ref = git_repo_ref;
+                repository_ref.m_host = repository.m_host;
+                repository_ref.m_subdir = repository.m_subdir;
+                sync_summary.start(index);
+                ::flying_start(repo, repository_ref, path, repository.m_remote, repository.m_local);
+                sync_summary.stop(index);
+                std::lock_guard<std::mutex> lock(synced_mutex);
+                synced[index] = true;
+                synced_changed.notify_all();
+            });
+            // the working trees of further branches, once the clones which
+            // they attach to are synced
+            repo::parallel_for_each(options.m_worktrees.begin(), options.m_worktrees.end(), options.m_sync_jobs,
+                [&](options_t::worktree_t const& worktree)
+            {
+                repo::repository_t const& repository = *std::find_if(repositories.begin(), repositories.end(),
+                    [&](repo::repository_t const& candidate) { return worktree.m_local == candidate.m_local; });
+                auto repository_ref = git_repo_ref;
+                repository_ref.m_host = repository.m_host;
+                repository_ref.m_subdir = repository.m_subdir;
+                repository_ref.m_branch = worktree.m_branch.c_str();
+                ::flying_start(repo, repository_ref, path, repository.m_remote, repository.m_local, worktree.m_dirname.c_str());
+            });
+            sync_summary.print(std::cout, repositories);
+            std::vector<repo::sync_summary_t::entry_t> const entries = sync_summary.entries();
+            for (size_t i = 0; i < repositories.size(); ++i)
+            {
+                repo::sync_history_t::entry_t entry;
+                entry.m_duration = std::chrono::duration_cast<std::chrono::milliseconds>(entries[i].m_duration);
+                entry.m_size = repo::get_object_size(path / repositories[i].m_local);
+                sync_history.record(repositories[i].m_local, entry);
+            }
+            try
+            {
+                sync_history.save();
+            }
+            catch (std::exception const& e)
+            {
+                std::cout << "Warning: cannot save the sync history: " << e.what() << std::endl;
+            }
+        }
+        catch (...)
+        {
+            std::lock_guard<std::mutex> lock(synced_mutex);
+            sync_error = std::current_exception();
+        }
+        std::lock_guard<std::mutex> lock(synced_mutex);
+        syncs_done = true;
+        synced_changed.notify_all();
+    });
+    try
+    {
+        repo::build_cache_t const build_cache(options.m_build_cache_dir, get_toolchain());
+        std::unique_ptr<repo::artifact_store_t> partifact_store;
+        if (!options.m_artifact_store_dir.empty())
+        {
+            partifact_store = std::make_unique<repo::artifact_store_t>(options.m_artifact_store_dir);
+        }
+        build_context_t build_context{ build_cache, partifact_store.get(), executor, path / "." FLYING_START / "log" };
+        for (size_t i = 0; i < repositories.size(); ++i)
+        {
+            {
+                std::unique_lock<std::mutex> lock(synced_mutex);
+                synced_changed.wait(lock, [&]() { return synced[i] || syncs_done; });
+                if (!synced[i])
+                {
+                    // a failed sync stops the syncs which did not start yet
+                    break;
+                }
+            }
+            cppmake(path, repositories[i], build_context);
+        }
+    }
+    catch (...)
+    {
+        syncer.join();
+        throw;
+    }
+    syncer.join();
+    if (sync_error)
+    {
+        std::rethrow_exception(sync_error);
+    }
+    if (options.m_maintenance)
+    {
+        maintain_all(repositories, path);
+    }
 }
 
 }; // anonymous
@@ -148,30 +711,84 @@ void flying_start(std::vector<repo::repository_t> const& repositories, int argc,
     {
         std::filesystem::path path = get_path(argc, argv);
         std::filesystem::current_path(path);
+        options_t const options = parse_options(path, argc, argv);
+        for (options_t::worktree_t const& worktree : options.m_worktrees)
+        {
+            if (std::none_of(repositories.begin(), repositories.end(),
+                [&](repo::repository_t const& repository) { return worktree.m_local == repository.m_local; }))
+            {
+                throw std::runtime_error("Unknown repository '" + worktree.m_local + "' in --worktree");
+            }
+        }
+        if (!options.m_request.empty())
+        {
+            // the client is typically a script, which must neither wait for
+            // enter nor miss that there is no daemon
+            try
+            {
+                repo::sync_daemon_t::request(path / "." FLYING_START / "daemon.sock", options.m_request, std::cout);
+            }
+            catch (std::exception const& e)
+            {
+                std::cerr << "Error: " << e.what() << std::endl;
+                std::exit(EXIT_FAILURE);
+            }
+            return;
+        }
         std::unique_ptr<repo::repo_t> prepo = repo::create_repo(std::cout, std::cin, ask_user_pwd);
+        archive_repo_ref_t git_repo_ref;
+        if (options.m_status != options_t::status_t::none)
+        {
+            // a read-only query, typically of a script, which does not wait for enter
+            print_status(std::cout, repositories, git_repo_ref, options.m_status);
+            return;
+        }
+        if (options.m_verify != options_t::verify_t::none)
+        {
+            // much cheaper than cloning again after a copy or a crash
+            repo::repair_t const repair =
+                (options.m_verify == options_t::verify_t::repair_all) ? repo::repair_t::all :
+                (options.m_verify == options_t::verify_t::repair) ? repo::repair_t::corrupt : repo::repair_t::none;
+            verify_all(std::cout, repositories, repair);
+            return;
+        }
+        repo::sync_options_t sync_options;
+        sync_options.m_line_progress = (options.m_sync_jobs > 1) && (repositories.size() > 1);
+        sync_options.m_partial_clone = options.m_partial_clone;
+        sync_options.m_archive_readers = options.m_archive_readers;
+        sync_options.m_worktrees = !options.m_worktrees.empty();
+        unsigned const concurrent_syncs = static_cast<unsigned>(std::min<size_t>(std::max(options.m_sync_jobs, 1u), repositories.size()));
+        sync_options.m_index_threads = options.m_index_threads;
+        sync_options.m_index_cache_size = options.m_index_cache_size ? options.m_index_cache_size :
+            options.m_memory_budget ? repo::get_index_cache_size(options.m_memory_budget, concurrent_syncs) : default_index_cache_size;
+        repo::set_sync_options(*prepo, sync_options);
+        if (options.m_memory_budget)
+        {
+            // else libgit2 keeps its own limits
+            repo::apply_memory_budget(options.m_memory_budget, concurrent_syncs);
+        }
         std::string commit_user;
-#if REPO_ARCHIVE_TYPE == REPO_ARCHIVE_USB
-        repo::gitfile_repo_ref_t git_repo_ref;
-#elif REPO_ARCHIVE_TYPE == REPO_ARCHIVE_GITHUB_HTTPS
-        repo::githttps_repo_ref_t git_repo_ref;
-#elif REPO_ARCHIVE_TYPE == REPO_ARCHIVE_GITHUB_SSH
-        repo::gitssh_repo_ref_t git_repo_ref;
-#endif
         if (!prepo->has_commit_user())
         {
             ask_commit_user(std::cout, std::cin, commit_user);
             git_repo_ref.m_commit_user = commit_user.c_str();
         }
-        for (repo::repository_t const& repository : repositories)
-        {
-            git_repo_ref.m_host = repository.m_host;
-            git_repo_ref.m_subdir = repository.m_subdir;
-            ::flying_start(*prepo, git_repo_ref, path, repository.m_remote, repository.m_local);
-        }
-        for (repo::repository_t const& repository : repositories)
+        // one jobserver for all builds of this process, also those of the daemon
+        repo::executor_t executor(options.m_build_jobs);
+        if (options.m_daemon_period != std::chrono::seconds::zero())
         {
-            cppmake(path, repository.m_local);
+            // keeps the repository, its caches and the parsed ssh configuration warm
+            std::filesystem::path const socket_path = path / "." FLYING_START / "daemon.sock";
+            std::filesystem::create_directories(socket_path.parent_path());
+            repo::sync_daemon_t daemon(
+                [&]() { sync_and_build(*prepo, git_repo_ref, repositories, path, options, executor); },
+                [&](std::ostream& os) { print_status(os, repositories, git_repo_ref, options_t::status_t::table); },
+                options.m_daemon_period);
+            std::cout << "Serving requests at '" << socket_path.string() << "'" << std::endl;
+            daemon.run(socket_path);
+            return;
         }
+        sync_and_build(*prepo, git_repo_ref, repositories, path, options, executor);
         std::cout << "done" << std::endl;
     }
     catch (std::exception const& e)
@@ -0,0 +1,30 @@
+#include "git_util.h"
+#include <sstream>
+#include <stdexcept>
+
+namespace repo
+{
+
+void check(int error)
+{
+    if (error < 0)
+    {
+        const git_error *e = giterr_last();
+        std::stringstream ss;
+        ss << error;
+        if (e)
+        {
+            ss << '/' << e->klass << ": " << e->message;
+        }
+        throw std::runtime_error(ss.str());
+    }
+}
+
+std::string to_string(git_oid const& oid)
+{
+    char hex[GIT_OID_HEXSZ + 1] = { 0 };
+    git_oid_fmt(hex, &oid);
+    return hex;
+}
+
+}; // namespace repo
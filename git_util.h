@@ -0,0 +1,19 @@
+#ifndef REPO_GIT_UTIL
+#define REPO_GIT_UTIL
+
+#include <string>
+#include "git2/git2.h"
+
+namespace repo
+{
+
+// Throws a std::runtime_error with the last libgit2 error for a negative
+// libgit2 return value
+void check(int error);
+
+// The 40 hex digits of 'oid'
+std::string to_string(git_oid const& oid);
+
+}; // namespace repo
+
+#endif // REPO_GIT_UTIL
@@ -0,0 +1,221 @@
+#include "local_socket.h"
+#include <stdexcept>
+#include <algorithm>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <afunix.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+namespace // anonymous
+{
+
+#ifdef _WIN32
+using native_socket_t = SOCKET;
+std::uintptr_t const invalid_handle = INVALID_SOCKET;
+
+void close_socket(std::uintptr_t handle)
+{
+    closesocket(static_cast<SOCKET>(handle));
+}
+
+std::string last_error()
+{
+    return "error " + std::to_string(WSAGetLastError());
+}
+
+native_socket_t create_socket()
+{
+    static struct winsock_t
+    {
+        winsock_t()
+        {
+            WSADATA wsa_data;
+            WSAStartup(MAKEWORD(2, 2), &wsa_data);
+        }
+        ~winsock_t()
+        {
+            WSACleanup();
+        }
+    } winsock;
+    return socket(AF_UNIX, SOCK_STREAM, 0);
+}
+#else
+using native_socket_t = int;
+std::uintptr_t const invalid_handle = static_cast<std::uintptr_t>(-1);
+int const send_flags =
+#ifdef MSG_NOSIGNAL
+    MSG_NOSIGNAL;
+#else
+    0;
+#endif
+
+void close_socket(std::uintptr_t handle)
+{
+    close(static_cast<int>(handle));
+}
+
+std::string last_error()
+{
+    return std::strerror(errno);
+}
+
+native_socket_t create_socket()
+{
+    return socket(AF_UNIX, SOCK_STREAM, 0);
+}
+#endif
+
+sockaddr_un make_address(std::filesystem::path const& path)
+{
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    std::string const name = path.string();
+    if (name.size() >= sizeof(address.sun_path))
+    {
+        throw std::runtime_error("Socket path too long: '" + name + "'");
+    }
+    std::copy(name.begin(), name.end(), address.sun_path);
+    return address;
+}
+
+}; // anonymous
+
+namespace repo
+{
+
+local_socket_t::local_socket_t(std::uintptr_t handle)
+    : m_handle(handle)
+{
+}
+
+local_socket_t::local_socket_t(local_socket_t&& other)
+    : m_handle(other.m_handle)
+{
+    other.m_handle = invalid_handle;
+}
+
+local_socket_t& local_socket_t::operator=(local_socket_t&& other)
+{
+    std::swap(m_handle, other.m_handle);
+    return *this;
+}
+
+local_socket_t::~local_socket_t()
+{
+    if (m_handle != invalid_handle)
+    {
+        close_socket(m_handle);
+    }
+}
+
+local_socket_t local_socket_t::listen(std::filesystem::path const& path)
+{
+    sockaddr_un const address = make_address(path);
+    local_socket_t listener(static_cast<std::uintptr_t>(create_socket()));
+    if (listener.m_handle == invalid_handle)
+    {
+        throw std::runtime_error("Cannot create socket: " + last_error());
+    }
+    // a socket file which is left behind by a daemon which did not stop
+    std::error_code ec;
+    std::filesystem::remove(path, ec);
+    if ((bind(static_cast<native_socket_t>(listener.m_handle), reinterpret_cast<sockaddr const*>(&address), sizeof(address)) != 0) ||
+        (::listen(static_cast<native_socket_t>(listener.m_handle), 8) != 0))
+    {
+        throw std::runtime_error("Cannot listen at '" + path.string() + "': " + last_error());
+    }
+    return listener;
+}
+
+local_socket_t local_socket_t::connect(std::filesystem::path const& path)
+{
+    sockaddr_un const address = make_address(path);
+    local_socket_t connection(static_cast<std::uintptr_t>(create_socket()));
+    if (connection.m_handle == invalid_handle)
+    {
+        throw std::runtime_error("Cannot create socket: " + last_error());
+    }
+    if (::connect(static_cast<native_socket_t>(connection.m_handle), reinterpret_cast<sockaddr const*>(&address), sizeof(address)) != 0)
+    {
+        throw std::runtime_error("Cannot connect to '" + path.string() + "': " + last_error());
+    }
+    return connection;
+}
+
+local_socket_t local_socket_t::accept()
+{
+    local_socket_t connection(static_cast<std::uintptr_t>(::accept(static_cast<native_socket_t>(m_handle), nullptr, nullptr)));
+    if (connection.m_handle == invalid_handle)
+    {
+        throw std::runtime_error("Cannot accept connection: " + last_error());
+    }
+    return connection;
+}
+
+void local_socket_t::set_timeout(std::chrono::milliseconds timeout)
+{
+#ifdef _WIN32
+    DWORD const value = static_cast<DWORD>(timeout.count());
+#else
+    timeval value = {};
+    value.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+    value.tv_usec = static_cast<suseconds_t>((timeout.count() % 1000) * 1000);
+#endif
+    for (int option : { SO_RCVTIMEO, SO_SNDTIMEO })
+    {
+        if (setsockopt(static_cast<native_socket_t>(m_handle), SOL_SOCKET, option,
+            reinterpret_cast<char const*>(&value), sizeof(value)) != 0)
+        {
+            throw std::runtime_error("Cannot set the socket timeout: " + last_error());
+        }
+    }
+}
+
+bool local_socket_t::read_line(std::string& line)
+{
+    line.clear();
+    char c;
+    int received;
+    while ((received = recv(static_cast<native_socket_t>(m_handle), &c, 1, 0)) == 1)
+    {
+        if (c == '\n')
+        {
+            return true;
+        }
+        line += c;
+    }
+    if (received < 0)
+    {
+        throw std::runtime_error("Cannot receive: " + last_error());
+    }
+    return !line.empty();
+}
+
+void local_socket_t::write(std::string const& data)
+{
+    size_t sent = 0;
+    while (sent < data.size())
+    {
+#ifdef _WIN32
+        int const result = send(static_cast<native_socket_t>(m_handle), data.data() + sent, static_cast<int>(data.size() - sent), 0);
+#else
+        ssize_t const result = send(static_cast<native_socket_t>(m_handle), data.data() + sent, data.size() - sent, send_flags);
+#endif
+        if (result <= 0)
+        {
+            throw std::runtime_error("Cannot send: " + last_error());
+        }
+        sent += static_cast<size_t>(result);
+    }
+}
+
+}; // namespace repo
@@ -0,0 +1,35 @@
+#ifndef REPO_LOCAL_SOCKET
+#define REPO_LOCAL_SOCKET
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace repo
+{
+
+// A stream socket of the local machine, bound to a path in the file system
+class local_socket_t
+{
+public:
+    static local_socket_t listen(std::filesystem::path const& path);
+    static local_socket_t connect(std::filesystem::path const& path);
+    local_socket_t(local_socket_t&& other);
+    local_socket_t& operator=(local_socket_t&& other);
+    ~local_socket_t();
+    local_socket_t accept();
+    // Makes reads and writes which wait longer than 'timeout' throw, where
+    // 0 waits forever
+    void set_timeout(std::chrono::milliseconds timeout);
+    // Reads up to and excluding a newline, or up to the end of the stream
+    bool read_line(std::string& line);
+    void write(std::string const& data);
+private:
+    explicit local_socket_t(std::uintptr_t handle);
+    std::uintptr_t m_handle;
+};
+
+}; // namespace repo
+
+#endif // REPO_LOCAL_SOCKET
@@ -0,0 +1,201 @@
+#include "maintenance.h"
+#include "platform_specific.h"
+#include <fstream>
+#include <stdexcept>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include "git_util.h"
+
+namespace // anonymous
+{
+
+using repo::check;
+
+struct pack_t
+{
+    std::filesystem::path m_idx;
+    uint32_t m_objects;
+};
+
+uint32_t read_uint32(std::istream& is)
+{
+    unsigned char bytes[4];
+    if (!is.read(reinterpret_cast<char*>(bytes), sizeof(bytes)))
+    {
+        throw std::runtime_error("Truncated pack index");
+    }
+    return (uint32_t(bytes[0]) << 24) | (uint32_t(bytes[1]) << 16) | (uint32_t(bytes[2]) << 8) | bytes[3];
+}
+
+// Reads the header of a version 2 pack index, which ends with the number
+// of objects in its pack, and optionally the object ids that follow it
+uint32_t read_idx(std::filesystem::path const& idx, std::vector<git_oid>* oids)
+{
+    std::ifstream ifs(idx, std::ios::binary);
+    if ((read_uint32(ifs) != 0xff744f63) || (read_uint32(ifs) != 2))
+    {
+        throw std::runtime_error("Unsupported pack index '" + idx.string() + "'");
+    }
+    ifs.seekg(255 * 4, std::ios::cur);
+    uint32_t const objects = read_uint32(ifs);
+    if (oids)
+    {
+        size_t const first = oids->size();
+        oids->resize(first + objects);
+        if (!ifs.read(reinterpret_cast<char*>(oids->data() + first), std::streamsize(objects) * sizeof(git_oid)))
+        {
+            throw std::runtime_error("Truncated pack index '" + idx.string() + "'");
+        }
+    }
+    return objects;
+}
+
+std::vector<pack_t> find_packs(std::filesystem::path const& pack_dir)
+{
+    std::vector<pack_t> packs;
+    for (std::filesystem::directory_entry const& entry : std::filesystem::directory_iterator(pack_dir))
+    {
+        std::filesystem::path const& idx = entry.path();
+        if (idx.extension() != ".idx")
+        {
+            continue;
+        }
+        std::filesystem::path keep(idx);
+        keep.replace_extension(".keep");
+        std::filesystem::path pack(idx);
+        pack.replace_extension(".pack");
+        if (std::filesystem::exists(keep) || !std::filesystem::exists(pack))
+        {
+            continue;
+        }
+        packs.push_back(pack_t{ idx, read_idx(idx, nullptr) });
+    }
+    std::sort(packs.begin(), packs.end(),
+        [](pack_t const& lhs, pack_t const& rhs) { return lhs.m_objects < rhs.m_objects; });
+    return packs;
+}
+
+// Returns the number of smallest packs to roll up into one pack, so that
+// each pack is at least twice as large as all smaller packs together
+size_t geometric_split(std::vector<pack_t> const& packs)
+{
+    size_t const factor = 2;
+    if (packs.size() < 2)
+    {
+        return 0;
+    }
+    size_t split = packs.size() - 1;
+    for (; split > 0; --split)
+    {
+        if (packs[split].m_objects < factor * packs[split - 1].m_objects)
+        {
+            break;
+        }
+    }
+    if (split == 0)
+    {
+        return 0;
+    }
+    uint64_t rolled_up = 0;
+    for (size_t i = 0; i <= split; ++i)
+    {
+        rolled_up += packs[i].m_objects;
+    }
+    for (++split; split < packs.size(); ++split)
+    {
+        if (packs[split].m_objects >= factor * rolled_up)
+        {
+            break;
+        }
+        rolled_up += packs[split].m_objects;
+    }
+    return split;
+}
+
+size_t count_loose_refs(std::filesystem::path const& refs_dir)
+{
+    size_t loose_refs = 0;
+    for (std::filesystem::directory_entry const& entry : std::filesystem::recursive_directory_iterator(refs_dir))
+    {
+        loose_refs += entry.is_regular_file() ? 1 : 0;
+    }
+    return loose_refs;
+}
+
+}; // anonymous
+
+namespace repo
+{
+
+void maintain(
+    std::filesystem::path const& repo_path,
+    maintenance_thresholds_t const& thresholds,
+    std::ostream& os)
+{
+    // packs are rewritten and removed, which a concurrent sync by another
+    // process must not see; maintenance waits for the next run instead
+    file_lock_t maintenance_lock(get_lock_path(repo_path));
+    if (!maintenance_lock.try_lock())
+    {
+        os << "Maintenance of '" << repo_path.filename().string() << "': skipped, being synced" << std::endl;
+        return;
+    }
+    git_repository *repo = NULL;
+    std::unique_ptr<git_repository, decltype(&::git_repository_free)>
+        repo_guard(repo, &::git_repository_free);
+    check(git_repository_open(&repo, repo_path.string().c_str()));
+    repo_guard.reset(repo);
+    std::filesystem::path const git_dir(git_repository_path(repo));
+    std::filesystem::path const pack_dir = git_dir / "objects" / "pack";
+    std::vector<pack_t> packs = find_packs(pack_dir);
+    size_t const split = (packs.size() > thresholds.m_max_packs) ? geometric_split(packs) : 0;
+    if (split > 1)
+    {
+        std::vector<git_oid> oids;
+        for (size_t i = 0; i < split; ++i)
+        {
+            read_idx(packs[i].m_idx, &oids);
+        }
+        git_packbuilder *packbuilder = NULL;
+        std::unique_ptr<git_packbuilder, decltype(&::git_packbuilder_free)>
+            packbuilder_guard(packbuilder, &::git_packbuilder_free);
+        check(git_packbuilder_new(&packbuilder, repo));
+        packbuilder_guard.reset(packbuilder);
+        for (git_oid const& oid : oids)
+        {
+            check(git_packbuilder_insert(packbuilder, &oid, NULL));
+        }
+        check(git_packbuilder_write(packbuilder, pack_dir.string().c_str(), 0, NULL, NULL));
+        os << "Maintenance of '" << repo_path.filename().string() << "': rolled up " << split << " packs with "
+            << oids.size() << " objects" << std::endl;
+    }
+    if (count_loose_refs(git_dir / "refs") > thresholds.m_max_loose_refs)
+    {
+        git_refdb *refdb = NULL;
+        std::unique_ptr<git_refdb, decltype(&::git_refdb_free)>
+            refdb_guard(refdb, &::git_refdb_free);
+        check(git_repository_refdb(&refdb, repo));
+        refdb_guard.reset(refdb);
+        check(git_refdb_compress(refdb));
+        os << "Maintenance of '" << repo_path.filename().string() << "': packed refs" << std::endl;
+    }
+    // the rolled up packs are still mapped by the repository
+    repo_guard.reset();
+    for (size_t i = 0; (split > 1) && (i < split); ++i)
+    {
+        std::filesystem::path pack(packs[i].m_idx);
+        pack.replace_extension(".pack");
+        std::error_code ec;
+        // packs are found through their index, so remove the index first;
+        // a pack which is still mapped by another process stays behind
+        std::filesystem::remove(packs[i].m_idx, ec);
+        if (!ec)
+        {
+            std::filesystem::remove(pack, ec);
+        }
+    }
+}
+
+}; // namespace repo
@@ -0,0 +1,29 @@
+#ifndef REPO_MAINTENANCE
+#define REPO_MAINTENANCE
+
+#include <filesystem>
+#include <ostream>
+
+namespace repo
+{
+
+struct maintenance_thresholds_t
+{
+    // consolidate when there are more packs than this
+    size_t m_max_packs = 4;
+    // pack the refs when there are more loose refs than this
+    size_t m_max_loose_refs = 32;
+};
+
+// Consolidates the packs of the repository in 'repo_path' geometrically,
+// i.e. rolls up the small packs while every remaining pack is at least
+// twice as large as all smaller ones together, and packs its loose refs.
+// Steps of which the thresholds show they are not needed are skipped.
+void maintain(
+    std::filesystem::path const& repo_path,
+    maintenance_thresholds_t const& thresholds,
+    std::ostream& os);
+
+}; // namespace repo
+
+#endif // REPO_MAINTENANCE
@@ -0,0 +1,38 @@
+#include "memory_budget.h"
+#include <algorithm>
+#include "git_util.h"
+
+namespace // anonymous
+{
+
+size_t const mebibyte = size_t(1) << 20;
+
+}; // anonymous
+
+namespace repo
+{
+
+void apply_memory_budget(size_t budget, unsigned concurrent_syncs)
+{
+    concurrent_syncs = std::max(concurrent_syncs, 1u);
+    /* half of the budget for mapped pack windows, a limit libgit2 applies
+       to all repositories together,
+       a quarter for the object caches, a limit libgit2 also applies to
+       all repositories together,
+       an eighth for the resolved bases of the pack indexers, see
+       get_index_cache_size(),
+       and an eighth for checkout buffers, which are not tunable */
+    size_t const mapped_limit = std::max(budget / 2, 8 * mebibyte);
+    size_t const window_size = std::clamp(mapped_limit / (8 * concurrent_syncs), mebibyte, size_t(sizeof(void*) < 8 ? 32 : 1024) * mebibyte);
+    size_t const cache_size = std::max(budget / 4, mebibyte);
+    check(git_libgit2_opts(GIT_OPT_SET_MWINDOW_MAPPED_LIMIT, mapped_limit));
+    check(git_libgit2_opts(GIT_OPT_SET_MWINDOW_SIZE, window_size));
+    check(git_libgit2_opts(GIT_OPT_SET_CACHE_MAX_SIZE, static_cast<ptrdiff_t>(cache_size)));
+}
+
+size_t get_index_cache_size(size_t budget, unsigned concurrent_syncs)
+{
+    return std::max(budget / 8 / std::max(concurrent_syncs, 1u), mebibyte);
+}
+
+}; // namespace repo
@@ -0,0 +1,20 @@
+#ifndef REPO_MEMORY_BUDGET
+#define REPO_MEMORY_BUDGET
+
+#include <cstddef>
+
+namespace repo
+{
+
+// Sizes the object caches and mapped pack windows of libgit2 so that
+// 'concurrent_syncs' syncs together stay within 'budget' bytes.
+// Must be called after libgit2 has been initialized, i.e. after create_repo().
+void apply_memory_budget(size_t budget, unsigned concurrent_syncs);
+
+// The share of 'budget' which each of 'concurrent_syncs' syncs keeps of the
+// resolved bases of a fetched pack, see sync_options_t::m_index_cache_size
+size_t get_index_cache_size(size_t budget, unsigned concurrent_syncs);
+
+}; // namespace repo
+
+#endif // REPO_MEMORY_BUDGET
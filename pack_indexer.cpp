@@ -0,0 +1,962 @@
+#include "pack_indexer.h"
+#include "platform_specific.h"
+#include <zlib.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+namespace // anonymous
+{
+
+enum : uint8_t
+{
+    obj_tag = 4,
+    obj_ofs_delta = 6,
+    obj_ref_delta = 7
+};
+
+char const* const type_names[] = { "", "commit", "tree", "blob", "tag" };
+
+size_t const pack_header_size = 12;
+size_t const pack_trailer_size = 20;
+// a type and size of up to 64 bits, followed by a base offset or id
+size_t const max_entry_header_size = 10 + 20;
+size_t const inflate_chunk_size = 1 << 16;
+
+std::chrono::milliseconds const progress_interval(100);
+
+typedef std::vector<uint8_t> buffer_t;
+
+uint32_t read_uint32(uint8_t const* data)
+{
+    return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | data[3];
+}
+
+void write_uint32(buffer_t& out, uint32_t value)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+    {
+        out.push_back(static_cast<uint8_t>(value >> shift));
+    }
+}
+
+std::string to_hex(repo::sha1_digest_t const& id)
+{
+    char const digits[] = "0123456789abcdef";
+    std::string hex;
+    for (uint8_t byte : id)
+    {
+        hex += digits[byte >> 4];
+        hex += digits[byte & 15];
+    }
+    return hex;
+}
+
+struct id_hash_t
+{
+    size_t operator()(repo::sha1_digest_t const& id) const
+    {
+        size_t hash;
+        std::memcpy(&hash, id.data(), sizeof(hash));
+        return hash;
+    }
+};
+
+// The id of an object, the hash of its type, size and content
+repo::sha1_digest_t object_id(uint8_t type, buffer_t const& object)
+{
+    std::string const header = std::string(type_names[type]) + ' ' + std::to_string(object.size());
+    repo::sha1_t hash;
+    hash.update(header.c_str(), header.size() + 1);
+    hash.update(object.data(), object.size());
+    return hash.digest();
+}
+
+// Applies a delta in git's format to its base
+buffer_t apply_delta(buffer_t const& base, buffer_t const& delta)
+{
+    uint8_t const* p = delta.data();
+    uint8_t const* const end = p + delta.size();
+    auto next = [&]() -> uint8_t
+    {
+        if (p == end)
+        {
+            throw std::runtime_error("Truncated delta in pack");
+        }
+        return *p++;
+    };
+    auto varint = [&]() -> uint64_t
+    {
+        uint64_t value = 0;
+        uint8_t c;
+        unsigned shift = 0;
+        do
+        {
+            c = next();
+            value |= uint64_t(c & 0x7f) << shift;
+            shift += 7;
+        } while ((c & 0x80) && (shift < 64));
+        return value;
+    };
+    if (varint() != base.size())
+    {
+        throw std::runtime_error("Delta does not match the size of its base in pack");
+    }
+    buffer_t object(varint());
+    size_t size = 0;
+    while (p != end)
+    {
+        uint8_t const cmd = next();
+        if (cmd & 0x80)
+        {
+            uint64_t offset = 0;
+            uint64_t length = 0;
+            for (unsigned i = 0; i < 4; ++i)
+            {
+                if (cmd & (1 << i))
+                {
+                    offset |= uint64_t(next()) << (8 * i);
+                }
+            }
+            for (unsigned i = 0; i < 3; ++i)
+            {
+                if (cmd & (0x10 << i))
+                {
+                    length |= uint64_t(next()) << (8 * i);
+                }
+            }
+            if (length == 0)
+            {
+                length = 0x10000;
+            }
+            if ((offset + length > base.size()) || (length > object.size() - size))
+            {
+                throw std::runtime_error("Delta copies out of bounds in pack");
+            }
+            std::memcpy(object.data() + size, base.data() + offset, length);
+            size += length;
+        }
+        else if (cmd)
+        {
+            if ((cmd > end - p) || (cmd > object.size() - size))
+            {
+                throw std::runtime_error("Delta inserts out of bounds in pack");
+            }
+            std::memcpy(object.data() + size, p, cmd);
+            p += cmd;
+            size += cmd;
+        }
+        else
+        {
+            throw std::runtime_error("Invalid delta instruction in pack");
+        }
+    }
+    if (size != object.size())
+    {
+        throw std::runtime_error("Delta does not match the size of its object in pack");
+    }
+    return object;
+}
+
+}; // anonymous
+
+namespace repo
+{
+
+// Resolves the deltas of a complete pack, in passes over the objects which
+// are their roots: first those in the pack, then the bases which are added
+// to a thin pack
+class pack_indexer_t::resolver_t
+{
+public:
+    explicit resolver_t(pack_indexer_t& indexer);
+    // Resolves the deltas based on the entries from 'first_root' on;
+    // returns false when canceled
+    bool run(size_t first_root, progress_t const& progress);
+    size_t resolved() const { return m_resolved; }
+    // The ids of bases which deltas wait for, but which are not in the pack
+    // as far as it is resolved
+    std::vector<sha1_digest_t> missing_bases() const;
+private:
+    typedef std::shared_ptr<buffer_t const> base_t;
+    struct task_t
+    {
+        size_t m_index;
+        base_t m_base;
+    };
+    void resolve();
+    void add_children(size_t index, buffer_t&& object, std::vector<task_t>& tasks);
+    bool has_children(size_t index) const;
+    base_t keep(buffer_t&& object);
+    buffer_t inflate(size_t index) const;
+    buffer_t materialize(size_t index) const;
+    pack_indexer_t& m_indexer;
+    std::vector<entry_t>& m_entries;
+    size_t const m_pack_entries;
+    // offset deltas grouped by their base, from m_first_child[base]
+    std::vector<size_t> m_first_child;
+    std::vector<size_t> m_children;
+    std::unordered_map<sha1_digest_t, std::vector<size_t>, id_hash_t> m_ref_children;
+    std::unique_ptr<std::atomic<bool>[]> m_claimed;
+    std::unique_ptr<mapped_file_t> m_pack;
+    std::vector<size_t> m_roots;
+    std::atomic<size_t> m_next_root;
+    std::atomic<size_t> m_resolved;
+    std::atomic<size_t> m_cached;
+    std::atomic<bool> m_abort;
+    std::mutex m_mutex;
+    std::condition_variable m_finished;
+    unsigned m_running;
+    std::exception_ptr m_error;
+};
+
+pack_indexer_t::resolver_t::resolver_t(pack_indexer_t& indexer)
+    : m_indexer(indexer)
+    , m_entries(indexer.m_entries)
+    , m_pack_entries(indexer.m_entries.size())
+    , m_first_child(m_pack_entries + 1, 0)
+    , m_claimed(new std::atomic<bool>[m_pack_entries]())
+    , m_next_root(0)
+    , m_resolved(0)
+    , m_cached(0)
+    , m_abort(false)
+    , m_running(0)
+{
+    // the entries are in the order of their offsets
+    for (size_t i = 0; i < m_pack_entries; ++i)
+    {
+        entry_t& entry = m_entries[i];
+        if (entry.m_type == obj_ofs_delta)
+        {
+            std::vector<entry_t>::const_iterator const pbase = std::lower_bound(m_entries.begin(), m_entries.begin() + i, entry.m_base_offset,
+                [](entry_t const& base, uint64_t offset) { return base.m_offset < offset; });
+            if ((pbase == m_entries.begin() + i) || (pbase->m_offset != entry.m_base_offset))
+            {
+                throw std::runtime_error("Invalid delta base offset in pack");
+            }
+            entry.m_base_index = pbase - m_entries.begin();
+            ++m_first_child[entry.m_base_index + 1];
+        }
+        else if (entry.m_type == obj_ref_delta)
+        {
+            m_ref_children[entry.m_base_id].push_back(i);
+        }
+    }
+    for (size_t i = 0; i < m_pack_entries; ++i)
+    {
+        m_first_child[i + 1] += m_first_child[i];
+    }
+    m_children.resize(m_first_child[m_pack_entries]);
+    std::vector<size_t> next_child(m_first_child.begin(), m_first_child.end() - 1);
+    for (size_t i = 0; i < m_pack_entries; ++i)
+    {
+        if (m_entries[i].m_type == obj_ofs_delta)
+        {
+            m_children[next_child[m_entries[i].m_base_index]++] = i;
+        }
+    }
+}
+
+bool pack_indexer_t::resolver_t::run(size_t first_root, progress_t const& progress)
+{
+    m_roots.clear();
+    for (size_t i = first_root; i < m_entries.size(); ++i)
+    {
+        if ((m_entries[i].m_type <= obj_tag) && has_children(i))
+        {
+            m_roots.push_back(i);
+        }
+    }
+    if (m_roots.empty())
+    {
+        return true;
+    }
+    m_pack = std::make_unique<mapped_file_t>(m_indexer.m_received_path);
+    m_next_root = 0;
+    unsigned const threads = static_cast<unsigned>(std::min<size_t>(std::max(m_indexer.m_threads, 1u), m_roots.size()));
+    m_running = threads;
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threads; ++i)
+    {
+        workers.emplace_back(&resolver_t::resolve, this);
+    }
+    bool canceled = false;
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        while (!m_finished.wait_for(lock, progress_interval, [this]() { return m_running == 0; }))
+        {
+            lock.unlock();
+            size_t const resolved = m_resolved;
+            m_indexer.m_progress.m_indexed_objects += resolved - m_indexer.m_progress.m_indexed_deltas;
+            m_indexer.m_progress.m_indexed_deltas = resolved;
+            if (!canceled && !progress(m_indexer.m_progress))
+            {
+                canceled = true;
+                m_abort = true;
+            }
+            lock.lock();
+        }
+    }
+    for (std::thread& worker : workers)
+    {
+        worker.join();
+    }
+    m_pack.reset();
+    if (m_error)
+    {
+        std::rethrow_exception(m_error);
+    }
+    size_t const resolved = m_resolved;
+    m_indexer.m_progress.m_indexed_objects += resolved - m_indexer.m_progress.m_indexed_deltas;
+    m_indexer.m_progress.m_indexed_deltas = resolved;
+    return !canceled;
+}
+
+std::vector<sha1_digest_t> pack_indexer_t::resolver_t::missing_bases() const
+{
+    std::vector<sha1_digest_t> ids;
+    for (auto const& ref_children : m_ref_children)
+    {
+        if (std::any_of(ref_children.second.begin(), ref_children.second.end(), [this](size_t child) { return !m_claimed[child]; }))
+        {
+            ids.push_back(ref_children.first);
+        }
+    }
+    return ids;
+}
+
+// Takes the next root and resolves the deltas based on it depth first, so
+// that only the bases on the way to the current delta are kept
+void pack_indexer_t::resolver_t::resolve()
+{
+    try
+    {
+        std::vector<task_t> tasks;
+        for (size_t root = m_next_root++; !m_abort && (root < m_roots.size()); root = m_next_root++)
+        {
+            add_children(m_roots[root], inflate(m_roots[root]), tasks);
+            while (!tasks.empty() && !m_abort)
+            {
+                task_t task = std::move(tasks.back());
+                tasks.pop_back();
+                entry_t& entry = m_entries[task.m_index];
+                buffer_t object = apply_delta(task.m_base ? *task.m_base : materialize(entry.m_base_index), inflate(task.m_index));
+                task.m_base.reset();
+                entry.m_object_type = m_entries[entry.m_base_index].m_object_type;
+                entry.m_id = object_id(entry.m_object_type, object);
+                ++m_resolved;
+                add_children(task.m_index, std::move(object), tasks);
+            }
+        }
+    }
+    catch (...)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_error)
+        {
+            m_error = std::current_exception();
+        }
+        m_abort = true;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        --m_running;
+    }
+    m_finished.notify_one();
+}
+
+// Adds the deltas based on the entry 'index', which is resolved to
+// 'object', to the tasks; a delta whose base id occurs twice in the pack
+// is taken by the first of them only
+void pack_indexer_t::resolver_t::add_children(size_t index, buffer_t&& object, std::vector<task_t>& tasks)
+{
+    base_t base;
+    bool kept = false;
+    auto add = [&](size_t child)
+    {
+        if (m_claimed[child].exchange(true))
+        {
+            return;
+        }
+        m_entries[child].m_base_index = index;
+        if (!kept)
+        {
+            base = keep(std::move(object));
+            kept = true;
+        }
+        tasks.push_back(task_t{ child, base });
+    };
+    if (index < m_pack_entries)
+    {
+        for (size_t i = m_first_child[index]; i < m_first_child[index + 1]; ++i)
+        {
+            add(m_children[i]);
+        }
+    }
+    auto const pref_children = m_ref_children.find(m_entries[index].m_id);
+    if (pref_children != m_ref_children.end())
+    {
+        for (size_t child : pref_children->second)
+        {
+            add(child);
+        }
+    }
+}
+
+bool pack_indexer_t::resolver_t::has_children(size_t index) const
+{
+    return ((index < m_pack_entries) && (m_first_child[index] != m_first_child[index + 1]))
+        || (m_ref_children.find(m_entries[index].m_id) != m_ref_children.end());
+}
+
+// Shares a resolved base between the deltas based on it, unless the cache
+// is full, when they resolve it again from its chain
+pack_indexer_t::resolver_t::base_t pack_indexer_t::resolver_t::keep(buffer_t&& object)
+{
+    size_t const size = object.size();
+    if (m_cached.fetch_add(size) + size > m_indexer.m_cache_size)
+    {
+        m_cached -= size;
+        return nullptr;
+    }
+    return base_t(new buffer_t(std::move(object)), [this, size](buffer_t const* cached)
+    {
+        m_cached -= size;
+        delete cached;
+    });
+}
+
+// The inflated data of the entry 'index', its object or delta
+buffer_t pack_indexer_t::resolver_t::inflate(size_t index) const
+{
+    entry_t const& entry = m_entries[index];
+    if (entry.m_data_offset > m_pack->size())
+    {
+        throw std::runtime_error("Invalid object offset in pack");
+    }
+    buffer_t data(entry.m_size);
+    z_stream stream = {};
+    if (inflateInit(&stream) != Z_OK)
+    {
+        throw std::runtime_error("Cannot initialize zlib");
+    }
+    std::unique_ptr<z_stream, decltype(&::inflateEnd)> stream_guard(&stream, &::inflateEnd);
+    uint8_t const* in = static_cast<uint8_t const*>(m_pack->data()) + entry.m_data_offset;
+    uint64_t in_left = m_pack->size() - entry.m_data_offset;
+    uint8_t empty = 0;
+    uint8_t* out = data.empty() ? &empty : data.data();
+    uint64_t out_left = data.size();
+    int ret;
+    do
+    {
+        if (!stream.avail_in)
+        {
+            stream.next_in = const_cast<Bytef*>(in);
+            stream.avail_in = static_cast<uInt>(std::min<uint64_t>(in_left, UINT_MAX));
+            in += stream.avail_in;
+            in_left -= stream.avail_in;
+        }
+        if (!stream.avail_out)
+        {
+            stream.next_out = out;
+            stream.avail_out = static_cast<uInt>(std::min<uint64_t>(out_left, UINT_MAX));
+            out += stream.avail_out;
+            out_left -= stream.avail_out;
+        }
+        ret = ::inflate(&stream, Z_NO_FLUSH);
+    } while (ret == Z_OK);
+    if ((ret != Z_STREAM_END) || out_left || stream.avail_out)
+    {
+        throw std::runtime_error("Corrupt object in pack");
+    }
+    return data;
+}
+
+// Resolves the entry 'index' from the start of its chain, for a base which
+// was not kept
+buffer_t pack_indexer_t::resolver_t::materialize(size_t index) const
+{
+    std::vector<size_t> chain;
+    for (; m_entries[index].m_type > obj_tag; index = m_entries[index].m_base_index)
+    {
+        chain.push_back(index);
+    }
+    buffer_t object = inflate(index);
+    for (std::vector<size_t>::const_reverse_iterator pdelta = chain.rbegin(); pdelta != chain.rend(); ++pdelta)
+    {
+        object = apply_delta(object, inflate(*pdelta));
+    }
+    return object;
+}
+
+pack_indexer_t::pack_indexer_t(std::filesystem::path const& pack_dir, unsigned threads, size_t cache_size)
+    : m_pack_dir(pack_dir)
+    , m_received_path(pack_dir / ("pack_indexer_" + std::to_string(reinterpret_cast<uintptr_t>(this)) + "_" +
+        std::to_string(std::chrono::steady_clock::now().time_since_epoch().count())))
+    , m_threads(threads)
+    , m_cache_size(cache_size)
+    , m_received(m_received_path, std::ios::binary | std::ios::trunc)
+    , m_state(state_t::pack_header)
+    , m_offset(0)
+    , m_pack_id()
+    , m_stream(new z_stream_s())
+    , m_inflated(inflate_chunk_size)
+    , m_inflated_size(0)
+{
+    if (!m_received)
+    {
+        throw std::runtime_error("Cannot create '" + m_received_path.string() + "'");
+    }
+    if (inflateInit(m_stream.get()) != Z_OK)
+    {
+        throw std::runtime_error("Cannot initialize zlib");
+    }
+}
+
+pack_indexer_t::~pack_indexer_t()
+{
+    inflateEnd(m_stream.get());
+    m_received.close();
+    // gone once the pack is committed
+    std::error_code ec;
+    std::filesystem::remove(m_received_path, ec);
+}
+
+void pack_indexer_t::append(void const* data, size_t size)
+{
+    m_received.write(static_cast<char const*>(data), size);
+    if (!m_received)
+    {
+        throw std::runtime_error("Cannot write '" + m_received_path.string() + "'");
+    }
+    uint8_t const* bytes = static_cast<uint8_t const*>(data);
+    while (size)
+    {
+        switch (m_state)
+        {
+        case state_t::pack_header:
+            append_pack_header(bytes, size);
+            break;
+        case state_t::entry_header:
+            append_entry_header(bytes, size);
+            break;
+        case state_t::entry_data:
+            append_entry_data(bytes, size);
+            break;
+        case state_t::trailer:
+            append_trailer(bytes, size);
+            break;
+        case state_t::done:
+            throw std::runtime_error("Unexpected data after the end of the pack");
+        }
+    }
+}
+
+void pack_indexer_t::append_pack_header(uint8_t const*& data, size_t& size)
+{
+    size_t const part = std::min(size, pack_header_size - m_header.size());
+    m_header.insert(m_header.end(), data, data + part);
+    data += part;
+    size -= part;
+    if (m_header.size() < pack_header_size)
+    {
+        return;
+    }
+    uint32_t const version = read_uint32(m_header.data() + 4);
+    if ((std::memcmp(m_header.data(), "PACK", 4) != 0) || ((version != 2) && (version != 3)))
+    {
+        throw std::runtime_error("Invalid pack header");
+    }
+    m_progress.m_total_objects = read_uint32(m_header.data() + 8);
+    m_entries.reserve(std::min<size_t>(m_progress.m_total_objects, 1 << 20));
+    m_pack_hash.update(m_header.data(), m_header.size());
+    m_offset = pack_header_size;
+    m_header.clear();
+    m_state = m_progress.m_total_objects ? state_t::entry_header : state_t::trailer;
+}
+
+void pack_indexer_t::append_entry_header(uint8_t const*& data, size_t& size)
+{
+    size_t const buffered = m_header.size();
+    size_t const part = std::min(size, max_entry_header_size - buffered);
+    m_header.insert(m_header.end(), data, data + part);
+    entry_t entry;
+    entry.m_offset = m_offset;
+    uint8_t const* p = m_header.data();
+    uint8_t const* const end = p + m_header.size();
+    bool const complete = [&]()
+    {
+        if (p == end)
+        {
+            return false;
+        }
+        uint8_t c = *p++;
+        entry.m_type = (c >> 4) & 7;
+        entry.m_size = c & 15;
+        for (unsigned shift = 4; c & 0x80; shift += 7)
+        {
+            if (p == end)
+            {
+                return false;
+            }
+            if (shift > 60)
+            {
+                throw std::runtime_error("Invalid object size in pack");
+            }
+            c = *p++;
+            entry.m_size |= uint64_t(c & 0x7f) << shift;
+        }
+        if (entry.m_type == obj_ofs_delta)
+        {
+            if (p == end)
+            {
+                return false;
+            }
+            c = *p++;
+            uint64_t distance = c & 0x7f;
+            while (c & 0x80)
+            {
+                if (p == end)
+                {
+                    return false;
+                }
+                if (distance >> 56)
+                {
+                    throw std::runtime_error("Invalid delta base offset in pack");
+                }
+                c = *p++;
+                distance = ((distance + 1) << 7) | (c & 0x7f);
+            }
+            if ((distance == 0) || (distance > m_offset))
+            {
+                throw std::runtime_error("Invalid delta base offset in pack");
+            }
+            entry.m_base_offset = m_offset - distance;
+        }
+        else if (entry.m_type == obj_ref_delta)
+        {
+            if (static_cast<size_t>(end - p) < entry.m_base_id.size())
+            {
+                return false;
+            }
+            std::memcpy(entry.m_base_id.data(), p, entry.m_base_id.size());
+            p += entry.m_base_id.size();
+        }
+        else if ((entry.m_type == 0) || (entry.m_type > obj_tag))
+        {
+            throw std::runtime_error("Invalid object type in pack");
+        }
+        return true;
+    }();
+    if (!complete)
+    {
+        if (m_header.size() == max_entry_header_size)
+        {
+            throw std::runtime_error("Invalid object header in pack");
+        }
+        data += part;
+        size -= part;
+        return;
+    }
+    size_t const length = p - m_header.data();
+    data += length - buffered;
+    size -= length - buffered;
+    entry.m_data_offset = m_offset + length;
+    entry.m_crc32 = crc32(0, m_header.data(), static_cast<uInt>(length));
+    m_pack_hash.update(m_header.data(), length);
+    m_offset += length;
+    m_header.clear();
+    if (entry.m_type <= obj_tag)
+    {
+        std::string const header = std::string(type_names[entry.m_type]) + ' ' + std::to_string(entry.m_size);
+        m_object_hash = sha1_t();
+        m_object_hash.update(header.c_str(), header.size() + 1);
+    }
+    m_entries.push_back(entry);
+    if (inflateReset(m_stream.get()) != Z_OK)
+    {
+        throw std::runtime_error("Cannot initialize zlib");
+    }
+    m_inflated_size = 0;
+    m_state = state_t::entry_data;
+}
+
+void pack_indexer_t::append_entry_data(uint8_t const*& data, size_t& size)
+{
+    entry_t& entry = m_entries.back();
+    z_stream& stream = *m_stream;
+    stream.next_in = const_cast<Bytef*>(data);
+    stream.avail_in = static_cast<uInt>(std::min<size_t>(size, UINT_MAX));
+    int ret;
+    do
+    {
+        stream.next_out = m_inflated.data();
+        stream.avail_out = static_cast<uInt>(m_inflated.size());
+        ret = ::inflate(&stream, Z_NO_FLUSH);
+        if ((ret != Z_OK) && (ret != Z_STREAM_END) && (ret != Z_BUF_ERROR))
+        {
+            throw std::runtime_error("Corrupt object in pack");
+        }
+        size_t const inflated = m_inflated.size() - stream.avail_out;
+        m_inflated_size += inflated;
+        if (m_inflated_size > entry.m_size)
+        {
+            throw std::runtime_error("Object larger than its size in pack");
+        }
+        if (entry.m_type <= obj_tag)
+        {
+            m_object_hash.update(m_inflated.data(), inflated);
+        }
+    } while ((ret == Z_OK) && !stream.avail_out);
+    size_t const consumed = stream.next_in - data;
+    entry.m_crc32 = crc32(entry.m_crc32, data, static_cast<uInt>(consumed));
+    m_pack_hash.update(data, consumed);
+    m_offset += consumed;
+    data += consumed;
+    size -= consumed;
+    if (ret != Z_STREAM_END)
+    {
+        return;
+    }
+    if (m_inflated_size != entry.m_size)
+    {
+        throw std::runtime_error("Object smaller than its size in pack");
+    }
+    if (entry.m_type <= obj_tag)
+    {
+        entry.m_id = m_object_hash.digest();
+        entry.m_object_type = entry.m_type;
+        ++m_progress.m_indexed_objects;
+    }
+    ++m_progress.m_received_objects;
+    m_state = (m_progress.m_received_objects == m_progress.m_total_objects) ? state_t::trailer : state_t::entry_header;
+}
+
+void pack_indexer_t::append_trailer(uint8_t const*& data, size_t& size)
+{
+    size_t const part = std::min(size, pack_trailer_size - m_header.size());
+    m_header.insert(m_header.end(), data, data + part);
+    data += part;
+    size -= part;
+    if (m_header.size() < pack_trailer_size)
+    {
+        return;
+    }
+    m_pack_id = m_pack_hash.digest();
+    if (!std::equal(m_pack_id.begin(), m_pack_id.end(), m_header.begin()))
+    {
+        throw std::runtime_error("Pack checksum mismatch");
+    }
+    m_header.clear();
+    m_state = state_t::done;
+}
+
+bool pack_indexer_t::commit(progress_t const& progress, lookup_t const& lookup)
+{
+    if (m_state != state_t::done)
+    {
+        throw std::runtime_error("Incomplete pack");
+    }
+    m_received.close();
+    if (!m_received)
+    {
+        throw std::runtime_error("Cannot write '" + m_received_path.string() + "'");
+    }
+    if (m_entries.empty())
+    {
+        return true;
+    }
+    m_progress.m_total_deltas = std::count_if(m_entries.begin(), m_entries.end(), [](entry_t const& entry) { return entry.m_type > obj_tag; });
+    m_progress.m_indexed_deltas = 0;
+    if (!progress(m_progress))
+    {
+        return false;
+    }
+    resolver_t resolver(*this);
+    for (size_t first_root = 0; ; )
+    {
+        if (!resolver.run(first_root, progress))
+        {
+            return false;
+        }
+        if (resolver.resolved() == m_progress.m_total_deltas)
+        {
+            break;
+        }
+        // a thin pack: the bases it lacks are added to it, as git_indexer
+        // does, and resolve the deltas which wait for them in another pass;
+        // these may be bases themselves
+        first_root = m_entries.size();
+        append_bases(resolver.missing_bases(), lookup);
+        if (m_entries.size() == first_root)
+        {
+            throw std::runtime_error("Missing delta base in pack");
+        }
+    }
+    if (!progress(m_progress))
+    {
+        return false;
+    }
+    std::string const name = "pack-" + to_hex(m_pack_id);
+    std::filesystem::path const pack = m_pack_dir / (name + ".pack");
+    std::filesystem::path const index = m_pack_dir / (name + ".idx");
+    if (std::filesystem::exists(index))
+    {
+        return true;
+    }
+    std::filesystem::path const received_index = m_received_path.string() + ".idx";
+    write_index(received_index);
+    std::filesystem::perms const read_only = std::filesystem::perms::owner_read | std::filesystem::perms::group_read | std::filesystem::perms::others_read;
+    std::filesystem::permissions(m_received_path, read_only);
+    std::filesystem::permissions(received_index, read_only);
+    // the index last, which makes the pack visible
+    std::filesystem::rename(m_received_path, pack);
+    std::filesystem::rename(received_index, index);
+    return true;
+}
+
+// Appends the bases 'ids' of a thin pack, as far as 'lookup' finds them,
+// and updates the object count and checksum of the pack
+void pack_indexer_t::append_bases(std::vector<sha1_digest_t> const& ids, lookup_t const& lookup)
+{
+    std::fstream pack(m_received_path, std::ios::binary | std::ios::in | std::ios::out);
+    pack.seekp(m_offset);
+    buffer_t object;
+    buffer_t compressed;
+    for (sha1_digest_t const& id : ids)
+    {
+        uint8_t type = 0;
+        if (!lookup(id, type, object))
+        {
+            continue;
+        }
+        if ((type == 0) || (type > obj_tag))
+        {
+            throw std::runtime_error("Invalid type of delta base " + to_hex(id));
+        }
+        entry_t entry;
+        entry.m_offset = m_offset;
+        entry.m_size = object.size();
+        entry.m_type = type;
+        entry.m_object_type = type;
+        entry.m_id = id;
+        uint8_t header[16];
+        size_t length = 0;
+        uint64_t size = object.size();
+        header[length++] = static_cast<uint8_t>((type << 4) | (size & 15) | ((size > 15) ? 0x80 : 0));
+        for (size >>= 4; size; size >>= 7)
+        {
+            header[length++] = static_cast<uint8_t>((size & 0x7f) | ((size > 0x7f) ? 0x80 : 0));
+        }
+        uLongf compressed_size = compressBound(static_cast<uLong>(object.size()));
+        compressed.resize(compressed_size);
+        if (compress(compressed.data(), &compressed_size, object.data(), static_cast<uLong>(object.size())) != Z_OK)
+        {
+            throw std::runtime_error("Cannot compress delta base " + to_hex(id));
+        }
+        entry.m_data_offset = m_offset + length;
+        entry.m_crc32 = crc32(crc32(0, header, static_cast<uInt>(length)), compressed.data(), static_cast<uInt>(compressed_size));
+        pack.write(reinterpret_cast<char const*>(header), length);
+        pack.write(reinterpret_cast<char const*>(compressed.data()), compressed_size);
+        m_offset += length + compressed_size;
+        m_entries.push_back(entry);
+    }
+    uint8_t count[4];
+    for (unsigned i = 0; i < 4; ++i)
+    {
+        count[i] = static_cast<uint8_t>(m_entries.size() >> (24 - 8 * i));
+    }
+    pack.seekp(8);
+    pack.write(reinterpret_cast<char const*>(count), sizeof(count));
+    pack.seekg(0);
+    sha1_t hash;
+    std::vector<char> chunk(inflate_chunk_size);
+    for (uint64_t left = m_offset; left; )
+    {
+        size_t const part = static_cast<size_t>(std::min<uint64_t>(left, chunk.size()));
+        pack.read(chunk.data(), part);
+        hash.update(chunk.data(), part);
+        left -= part;
+    }
+    m_pack_id = hash.digest();
+    pack.seekp(m_offset);
+    pack.write(reinterpret_cast<char const*>(m_pack_id.data()), m_pack_id.size());
+    pack.close();
+    if (!pack)
+    {
+        throw std::runtime_error("Cannot write '" + m_received_path.string() + "'");
+    }
+    std::filesystem::resize_file(m_received_path, m_offset + pack_trailer_size);
+}
+
+// Writes an index of version 2 for the pack
+void pack_indexer_t::write_index(std::filesystem::path const& path) const
+{
+    std::vector<size_t> order(m_entries.size());
+    for (size_t i = 0; i < order.size(); ++i)
+    {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [this](size_t a, size_t b) { return m_entries[a].m_id < m_entries[b].m_id; });
+    buffer_t index = { 0xff, 't', 'O', 'c' };
+    write_uint32(index, 2);
+    size_t count = 0;
+    for (unsigned first_byte = 0; first_byte < 256; ++first_byte)
+    {
+        while ((count < order.size()) && (m_entries[order[count]].m_id[0] == first_byte))
+        {
+            ++count;
+        }
+        write_uint32(index, static_cast<uint32_t>(count));
+    }
+    for (size_t i : order)
+    {
+        index.insert(index.end(), m_entries[i].m_id.begin(), m_entries[i].m_id.end());
+    }
+    for (size_t i : order)
+    {
+        write_uint32(index, m_entries[i].m_crc32);
+    }
+    std::vector<uint64_t> large_offsets;
+    for (size_t i : order)
+    {
+        uint64_t const offset = m_entries[i].m_offset;
+        if (offset < 0x80000000)
+        {
+            write_uint32(index, static_cast<uint32_t>(offset));
+        }
+        else
+        {
+            write_uint32(index, static_cast<uint32_t>(0x80000000 | large_offsets.size()));
+            large_offsets.push_back(offset);
+        }
+    }
+    for (uint64_t offset : large_offsets)
+    {
+        write_uint32(index, static_cast<uint32_t>(offset >> 32));
+        write_uint32(index, static_cast<uint32_t>(offset));
+    }
+    index.insert(index.end(), m_pack_id.begin(), m_pack_id.end());
+    sha1_t hash;
+    hash.update(index.data(), index.size());
+    sha1_digest_t const index_id = hash.digest();
+    index.insert(index.end(), index_id.begin(), index_id.end());
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<char const*>(index.data()), index.size());
+    out.close();
+    if (!out)
+    {
+        throw std::runtime_error("Cannot write '" + path.string() + "'");
+    }
+}
+
+}; // namespace repo
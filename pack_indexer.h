@@ -0,0 +1,104 @@
+#ifndef REPO_PACK_INDEXER
+#define REPO_PACK_INDEXER
+
+#include "sha1.h"
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <vector>
+
+struct z_stream_s;
+
+namespace repo
+{
+
+// The counters of git_transfer_progress which the indexer updates
+struct index_progress_t
+{
+    size_t m_total_objects = 0;
+    size_t m_indexed_objects = 0;
+    size_t m_received_objects = 0;
+    size_t m_total_deltas = 0;
+    size_t m_indexed_deltas = 0;
+};
+
+// Indexes a pack while it is received, as git_indexer does, except that the
+// deltas are resolved on several threads once the pack is complete: each
+// thread takes the next object which is not a delta and resolves the delta
+// chains based on it, depth first. The resolved bases which deltas still
+// wait for are shared by the threads and kept up to 'cache_size' bytes;
+// beyond that, a base is resolved again from its chain when it is needed.
+class pack_indexer_t
+{
+public:
+    // Called with the counters while the deltas are resolved; returns
+    // false to cancel
+    typedef std::function<bool(index_progress_t const&)> progress_t;
+    // Reads the object 'id' from the repository, for the bases which a
+    // thin pack leaves out; returns false when it is not there
+    typedef std::function<bool(sha1_digest_t const& id, uint8_t& type, std::vector<uint8_t>& data)> lookup_t;
+    pack_indexer_t(std::filesystem::path const& pack_dir, unsigned threads, size_t cache_size);
+    ~pack_indexer_t();
+    pack_indexer_t(pack_indexer_t const&) = delete;
+    pack_indexer_t& operator=(pack_indexer_t const&) = delete;
+    // Stores and parses the next part of the pack; throws when it is invalid
+    void append(void const* data, size_t size);
+    index_progress_t const& progress() const { return m_progress; }
+    // Resolves the deltas, completes a thin pack with the bases it lacks
+    // and moves the pack with its index into the pack directory; returns
+    // false when canceled
+    bool commit(progress_t const& progress, lookup_t const& lookup);
+private:
+    enum class state_t
+    {
+        pack_header,
+        entry_header,
+        entry_data,
+        trailer,
+        done
+    };
+    struct entry_t
+    {
+        uint64_t m_offset = 0;
+        uint64_t m_data_offset = 0;
+        // inflated size, of the delta for deltas
+        uint64_t m_size = 0;
+        uint64_t m_base_offset = 0;
+        size_t m_base_index = 0;
+        sha1_digest_t m_base_id = {};
+        sha1_digest_t m_id = {};
+        uint32_t m_crc32 = 0;
+        // the type in the pack, and that of the object once it is resolved
+        uint8_t m_type = 0;
+        uint8_t m_object_type = 0;
+    };
+    class resolver_t;
+    void append_pack_header(uint8_t const*& data, size_t& size);
+    void append_entry_header(uint8_t const*& data, size_t& size);
+    void append_entry_data(uint8_t const*& data, size_t& size);
+    void append_trailer(uint8_t const*& data, size_t& size);
+    void append_bases(std::vector<sha1_digest_t> const& ids, lookup_t const& lookup);
+    void write_index(std::filesystem::path const& path) const;
+    std::filesystem::path m_pack_dir;
+    std::filesystem::path m_received_path;
+    unsigned m_threads;
+    size_t m_cache_size;
+    std::ofstream m_received;
+    state_t m_state;
+    std::vector<uint8_t> m_header;
+    uint64_t m_offset;
+    sha1_t m_pack_hash;
+    sha1_digest_t m_pack_id;
+    sha1_t m_object_hash;
+    std::unique_ptr<z_stream_s> m_stream;
+    std::vector<uint8_t> m_inflated;
+    uint64_t m_inflated_size;
+    std::vector<entry_t> m_entries;
+    index_progress_t m_progress;
+};
+
+}; // namespace repo
+
+#endif // REPO_PACK_INDEXER
@@ -0,0 +1,174 @@
+#include "pack_indexer_backend.h"
+#include "pack_indexer.h"
+#include "git_util.h"
+#include "git2/sys/odb_backend.h"
+#include <exception>
+#include <filesystem>
+#include <memory>
+
+namespace // anonymous
+{
+
+// Above the pack backend of libgit2, GIT_PACKED_PRIORITY, so that
+// git_odb_write_pack() takes this backend
+int const backend_priority = 3;
+
+// An object database backend which only writes packs; the backends of
+// libgit2 read the objects, also those of the packs written here
+struct backend_t
+    : git_odb_backend
+{
+    std::filesystem::path m_pack_dir;
+    unsigned m_threads;
+    size_t m_cache_size;
+};
+
+struct writepack_t
+    : git_odb_writepack
+{
+    git_odb* m_odb;
+    git_transfer_progress_cb m_progress_cb;
+    void* m_progress_payload;
+    std::unique_ptr<repo::pack_indexer_t> m_indexer;
+};
+
+// Reports the exception which stops the indexer as a libgit2 error
+int fail(std::exception const& e)
+{
+    giterr_set_str(GITERR_INDEXER, e.what());
+    return -1;
+}
+
+// Reports the counters of the indexer, as git_indexer would
+int report_progress(writepack_t* writepack, git_transfer_progress* stats)
+{
+    repo::index_progress_t const& progress = writepack->m_indexer->progress();
+    stats->total_objects = static_cast<unsigned int>(progress.m_total_objects);
+    stats->indexed_objects = static_cast<unsigned int>(progress.m_indexed_objects);
+    stats->received_objects = static_cast<unsigned int>(progress.m_received_objects);
+    stats->local_objects = 0;
+    stats->total_deltas = static_cast<unsigned int>(progress.m_total_deltas);
+    stats->indexed_deltas = static_cast<unsigned int>(progress.m_indexed_deltas);
+    return writepack->m_progress_cb ? writepack->m_progress_cb(stats, writepack->m_progress_payload) : 0;
+}
+
+int writepack_append(git_odb_writepack* writepack, void const* data, size_t size, git_transfer_progress* stats)
+{
+    writepack_t* This = static_cast<writepack_t*>(writepack);
+    try
+    {
+        This->m_indexer->append(data, size);
+    }
+    catch (std::exception const& e)
+    {
+        return fail(e);
+    }
+    return report_progress(This, stats);
+}
+
+int writepack_commit(git_odb_writepack* writepack, git_transfer_progress* stats)
+{
+    writepack_t* This = static_cast<writepack_t*>(writepack);
+    int error = 0;
+    try
+    {
+        bool const committed = This->m_indexer->commit([&](repo::index_progress_t const&)
+        {
+            error = report_progress(This, stats);
+            return error == 0;
+        }, [&](repo::sha1_digest_t const& id, uint8_t& type, std::vector<uint8_t>& data)
+        {
+            git_oid oid;
+            git_oid_fromraw(&oid, id.data());
+            git_odb_object *object = NULL;
+            if (git_odb_read(&object, This->m_odb, &oid) < 0)
+            {
+                giterr_clear();
+                return false;
+            }
+            std::unique_ptr<git_odb_object, decltype(&::git_odb_object_free)>
+                object_guard(object, &::git_odb_object_free);
+            type = static_cast<uint8_t>(git_odb_object_type(object));
+            uint8_t const* content = static_cast<uint8_t const*>(git_odb_object_data(object));
+            data.assign(content, content + git_odb_object_size(object));
+            return true;
+        });
+        if (!committed)
+        {
+            return error;
+        }
+    }
+    catch (std::exception const& e)
+    {
+        return fail(e);
+    }
+    // the pack backend finds the new pack
+    return git_odb_refresh(This->m_odb);
+}
+
+void writepack_free(git_odb_writepack* writepack)
+{
+    delete static_cast<writepack_t*>(writepack);
+}
+
+int backend_writepack(git_odb_writepack** out, git_odb_backend* backend, git_odb* odb,
+    git_transfer_progress_cb progress_cb, void* progress_payload)
+{
+    backend_t* This = static_cast<backend_t*>(backend);
+    try
+    {
+        std::unique_ptr<writepack_t> writepack = std::make_unique<writepack_t>();
+        writepack->backend = backend;
+        writepack->append = writepack_append;
+        writepack->commit = writepack_commit;
+        writepack->free = writepack_free;
+        writepack->m_odb = odb;
+        writepack->m_progress_cb = progress_cb;
+        writepack->m_progress_payload = progress_payload;
+        writepack->m_indexer = std::make_unique<repo::pack_indexer_t>(This->m_pack_dir, This->m_threads, This->m_cache_size);
+        *out = writepack.release();
+    }
+    catch (std::exception const& e)
+    {
+        return fail(e);
+    }
+    return 0;
+}
+
+int backend_foreach(git_odb_backend*, git_odb_foreach_cb, void*)
+{
+    return 0;
+}
+
+void backend_free(git_odb_backend* backend)
+{
+    delete static_cast<backend_t*>(backend);
+}
+
+}; // anonymous
+
+namespace repo
+{
+
+void add_pack_indexer(git_repository* repo, unsigned threads, size_t cache_size)
+{
+    git_odb *odb = NULL;
+    std::unique_ptr<git_odb, decltype(&::git_odb_free)>
+        odb_guard(odb, &::git_odb_free);
+    check(git_repository_odb(&odb, repo));
+    odb_guard.reset(odb);
+    std::unique_ptr<backend_t> backend = std::make_unique<backend_t>();
+    check(git_odb_init_backend(backend.get(), GIT_ODB_BACKEND_VERSION));
+    backend->writepack = backend_writepack;
+    backend->foreach = backend_foreach;
+    backend->free = backend_free;
+    // the object database of a linked working tree is in the common directory
+    backend->m_pack_dir = std::filesystem::path(git_repository_commondir(repo)) / "objects" / "pack";
+    backend->m_threads = threads;
+    backend->m_cache_size = cache_size;
+    check(git_odb_add_backend(odb, backend.get(), backend_priority));
+    // owned by the object database from now on
+    backend.release();
+}
+
+}; // namespace repo
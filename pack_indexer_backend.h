@@ -0,0 +1,17 @@
+#ifndef REPO_PACK_INDEXER_BACKEND
+#define REPO_PACK_INDEXER_BACKEND
+
+#include <cstddef>
+#include "git2/git2.h"
+
+namespace repo
+{
+
+// Makes the fetches into 'repo' index the packs they receive with a
+// pack_indexer_t, which resolves the deltas on 'threads' threads and keeps
+// up to 'cache_size' bytes of resolved bases
+void add_pack_indexer(git_repository* repo, unsigned threads, size_t cache_size);
+
+}; // namespace repo
+
+#endif // REPO_PACK_INDEXER_BACKEND
@@ -0,0 +1,62 @@
+#ifndef REPO_PARALLEL
+#define REPO_PARALLEL
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace repo
+{
+
+// Calls 'function' for each element of [first, last) on at most 'jobs'
+// threads, in order of the elements. The first exception thrown stops the
+// remaining elements from being started and is rethrown to the caller.
+template <typename iterator_t, typename function_t>
+void parallel_for_each(iterator_t first, iterator_t last, unsigned jobs, function_t function)
+{
+    size_t const count = std::distance(first, last);
+    std::atomic<size_t> next(0);
+    std::mutex error_mutex;
+    std::exception_ptr error;
+    auto worker = [&]()
+    {
+        for (size_t i = next++; i < count; i = next++)
+        {
+            try
+            {
+                function(*std::next(first, i));
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(error_mutex);
+                if (!error)
+                {
+                    error = std::current_exception();
+                }
+                next = count;
+            }
+        }
+    };
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < std::min<size_t>(std::max(jobs, 1u), count); ++i)
+    {
+        threads.emplace_back(worker);
+    }
+    worker();
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+}; // namespace repo
+
+#endif // REPO_PARALLEL
@@ -3,10 +3,30 @@
 #ifdef _WIN32
 #include <windows.h>
 #include <Lmcons.h>
+#include <psapi.h>
 #else
 #include <termios.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fstream>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <sys/statfs.h>
+#include <sys/sysmacros.h>
 #endif
+#include <cerrno>
+extern char **environ;
+#endif
+#include <stdexcept>
+#include <memory>
+#include <algorithm>
+#include <cstring>
 
 namespace repo
 {
@@ -52,4 +72,613 @@ char const* get_username()
 #endif
 }
 
+#ifdef _WIN32
+
+namespace // anonymous
+{
+
+// quotes an argument the way CommandLineToArgvW splits it again
+std::string quote_argument(std::string const& arg)
+{
+    if (!arg.empty() && arg.find_first_of(" \t\"") == std::string::npos)
+    {
+        return arg;
+    }
+    std::string quoted("\"");
+    size_t backslashes = 0;
+    for (char c : arg)
+    {
+        if (c == '\\')
+        {
+            ++backslashes;
+            continue;
+        }
+        quoted.append(c == '"' ? 2 * backslashes + 1 : backslashes, '\\');
+        quoted += c;
+        backslashes = 0;
+    }
+    quoted.append(2 * backslashes, '\\');
+    quoted += '"';
+    return quoted;
+}
+
+HANDLE create_output_file(std::filesystem::path const& path)
+{
+    SECURITY_ATTRIBUTES security_attributes = { sizeof(SECURITY_ATTRIBUTES), NULL, TRUE };
+    HANDLE handle = CreateFileW(path.wstring().c_str(), GENERIC_WRITE, FILE_SHARE_READ,
+        &security_attributes, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        throw std::runtime_error("Cannot create '" + path.string() + "'");
+    }
+    return handle;
+}
+
+}; // anonymous
+
+#endif
+
+namespace // anonymous
+{
+
+// True when 'variable', as NAME=value, is set again in 'environment'
+bool is_overridden(char const* variable, std::vector<std::string> const& environment)
+{
+    for (std::string const& added : environment)
+    {
+        size_t const name_size = added.find('=') + 1;
+#ifdef _WIN32
+        // names are case insensitive
+        if (_strnicmp(variable, added.c_str(), name_size) == 0)
+#else
+        if (std::strncmp(variable, added.c_str(), name_size) == 0)
+#endif
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+}; // anonymous
+
+int spawn_and_wait(
+    std::vector<std::string> const& args,
+    std::filesystem::path const& working_dir,
+    std::filesystem::path const& stdout_path,
+    std::filesystem::path const& stderr_path,
+    std::vector<std::string> const& environment)
+{
+    if (args.empty())
+    {
+        throw std::logic_error("No command to spawn");
+    }
+#ifdef _WIN32
+    std::string command_line;
+    for (std::string const& arg : args)
+    {
+        command_line += (command_line.empty() ? "" : " ") + quote_argument(arg);
+    }
+    // a block of NAME=value strings, ended by an empty one
+    std::string environment_block;
+    {
+        std::unique_ptr<char, decltype(&::FreeEnvironmentStringsA)> strings(GetEnvironmentStringsA(), &::FreeEnvironmentStringsA);
+        for (char const* variable = strings.get(); variable && *variable; variable += std::strlen(variable) + 1)
+        {
+            if (!is_overridden(variable, environment))
+            {
+                environment_block.append(variable, std::strlen(variable) + 1);
+            }
+        }
+    }
+    for (std::string const& variable : environment)
+    {
+        environment_block.append(variable.c_str(), variable.size() + 1);
+    }
+    environment_block += '\0';
+    std::unique_ptr<void, decltype(&::CloseHandle)> stdout_guard(create_output_file(stdout_path), &::CloseHandle);
+    std::unique_ptr<void, decltype(&::CloseHandle)> stderr_guard(create_output_file(stderr_path), &::CloseHandle);
+    // the child inherits its own log files only, not those of the jobs
+    // which other threads start at the same time
+    HANDLE handles[] = { stdout_guard.get(), stderr_guard.get() };
+    SIZE_T attribute_list_size = 0;
+    InitializeProcThreadAttributeList(NULL, 1, 0, &attribute_list_size);
+    std::vector<char> attribute_list_buffer(attribute_list_size);
+    LPPROC_THREAD_ATTRIBUTE_LIST attribute_list = reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(attribute_list_buffer.data());
+    if (!InitializeProcThreadAttributeList(attribute_list, 1, 0, &attribute_list_size))
+    {
+        throw std::runtime_error("Cannot start '" + command_line + "'");
+    }
+    std::unique_ptr<_PROC_THREAD_ATTRIBUTE_LIST, decltype(&::DeleteProcThreadAttributeList)>
+        attribute_list_guard(attribute_list, &::DeleteProcThreadAttributeList);
+    if (!UpdateProcThreadAttribute(attribute_list, 0, PROC_THREAD_ATTRIBUTE_HANDLE_LIST, handles, sizeof(handles), NULL, NULL))
+    {
+        throw std::runtime_error("Cannot start '" + command_line + "'");
+    }
+    STARTUPINFOEXA startup_info = { { sizeof(STARTUPINFOEXA) } };
+    startup_info.StartupInfo.dwFlags = STARTF_USESTDHANDLES;
+    startup_info.StartupInfo.hStdInput = INVALID_HANDLE_VALUE;
+    startup_info.StartupInfo.hStdOutput = stdout_guard.get();
+    startup_info.StartupInfo.hStdError = stderr_guard.get();
+    startup_info.lpAttributeList = attribute_list;
+    PROCESS_INFORMATION process_information = { 0 };
+    if (!CreateProcessA(NULL, &command_line[0], NULL, NULL, TRUE, CREATE_NO_WINDOW | EXTENDED_STARTUPINFO_PRESENT, &environment_block[0],
+        working_dir.string().c_str(), &startup_info.StartupInfo, &process_information))
+    {
+        throw std::runtime_error("Cannot start '" + command_line + "'");
+    }
+    std::unique_ptr<void, decltype(&::CloseHandle)> process_guard(process_information.hProcess, &::CloseHandle);
+    CloseHandle(process_information.hThread);
+    WaitForSingleObject(process_information.hProcess, INFINITE);
+    DWORD exit_code = 0;
+    GetExitCodeProcess(process_information.hProcess, &exit_code);
+    return static_cast<int>(exit_code);
+#else
+    std::vector<char*> argv;
+    for (std::string const& arg : args)
+    {
+        argv.push_back(const_cast<char*>(arg.c_str()));
+    }
+    argv.push_back(nullptr);
+    std::vector<char*> envp;
+    for (char** pvariable = environ; *pvariable; ++pvariable)
+    {
+        if (!is_overridden(*pvariable, environment))
+        {
+            envp.push_back(*pvariable);
+        }
+    }
+    for (std::string const& variable : environment)
+    {
+        envp.push_back(const_cast<char*>(variable.c_str()));
+    }
+    envp.push_back(nullptr);
+    posix_spawn_file_actions_t file_actions;
+    posix_spawn_file_actions_init(&file_actions);
+    posix_spawn_file_actions_addopen(&file_actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&file_actions, STDOUT_FILENO, stdout_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    posix_spawn_file_actions_addopen(&file_actions, STDERR_FILENO, stderr_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    // the child changes its directory, this process keeps its current path
+    posix_spawn_file_actions_addchdir_np(&file_actions, working_dir.c_str());
+    pid_t pid;
+    int error = posix_spawnp(&pid, argv[0], &file_actions, NULL, argv.data(), envp.data());
+    posix_spawn_file_actions_destroy(&file_actions);
+    if (error)
+    {
+        throw std::runtime_error("Cannot start '" + args[0] + "': " + std::strerror(error));
+    }
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+        {
+            throw std::runtime_error("Cannot wait for '" + args[0] + "': " + std::strerror(errno));
+        }
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+#endif
+}
+
+jobserver_t::jobserver_t(unsigned jobs)
+    : m_jobs(std::max(jobs, 1u))
+{
+#ifdef _WIN32
+    // make opens the semaphore by its name
+    m_name = "flying_start_jobserver_" + std::to_string(GetCurrentProcessId()) + "_" + std::to_string(reinterpret_cast<uintptr_t>(this));
+    HANDLE const semaphore = CreateSemaphoreA(NULL, m_jobs, m_jobs, m_name.c_str());
+    if (!semaphore)
+    {
+        throw std::runtime_error("Cannot create the jobserver semaphore '" + m_name + "'");
+    }
+    m_handles[0] = m_handles[1] = reinterpret_cast<intptr_t>(semaphore);
+#else
+    // make inherits the pipe, so it is not closed on exec
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        throw std::runtime_error(std::string("Cannot create the jobserver pipe: ") + std::strerror(errno));
+    }
+    m_handles[0] = fds[0];
+    m_handles[1] = fds[1];
+    for (unsigned i = 0; i < m_jobs; ++i)
+    {
+        release();
+    }
+#endif
+}
+
+jobserver_t::~jobserver_t()
+{
+#ifdef _WIN32
+    CloseHandle(reinterpret_cast<HANDLE>(m_handles[0]));
+#else
+    close(static_cast<int>(m_handles[0]));
+    close(static_cast<int>(m_handles[1]));
+#endif
+}
+
+void jobserver_t::acquire()
+{
+#ifdef _WIN32
+    if (WaitForSingleObject(reinterpret_cast<HANDLE>(m_handles[0]), INFINITE) != WAIT_OBJECT_0)
+    {
+        throw std::runtime_error("Cannot take a jobserver token");
+    }
+#else
+    char token;
+    ssize_t read_size;
+    while (((read_size = read(static_cast<int>(m_handles[0]), &token, 1)) < 0) && (errno == EINTR));
+    if (read_size != 1)
+    {
+        throw std::runtime_error("Cannot take a jobserver token");
+    }
+#endif
+}
+
+void jobserver_t::release()
+{
+#ifdef _WIN32
+    ReleaseSemaphore(reinterpret_cast<HANDLE>(m_handles[0]), 1, NULL);
+#else
+    char const token = '+';
+    while ((write(static_cast<int>(m_handles[1]), &token, 1) < 0) && (errno == EINTR));
+#endif
+}
+
+std::string jobserver_t::makeflags() const
+{
+#ifdef _WIN32
+    return "-j" + std::to_string(m_jobs) + " --jobserver-auth=" + m_name;
+#else
+    return "-j" + std::to_string(m_jobs) + " --jobserver-auth=" + std::to_string(m_handles[0]) + "," + std::to_string(m_handles[1]);
+#endif
+}
+
+size_t get_physical_memory()
+{
+#ifdef _WIN32
+    MEMORYSTATUSEX memory_status = { sizeof(MEMORYSTATUSEX) };
+    return GlobalMemoryStatusEx(&memory_status) ? static_cast<size_t>(memory_status.ullTotalPhys) : 0;
+#elif defined _SC_PHYS_PAGES
+    long const pages = sysconf(_SC_PHYS_PAGES);
+    return (pages > 0) ? size_t(pages) * size_t(sysconf(_SC_PAGESIZE)) : 0;
+#else
+    return 0;
+#endif
+}
+
+size_t get_resident_memory()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters = { sizeof(PROCESS_MEMORY_COUNTERS) };
+    return GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)) ? counters.WorkingSetSize : 0;
+#elif defined __linux__
+    std::ifstream statm("/proc/self/statm");
+    size_t size = 0;
+    size_t resident = 0;
+    statm >> size >> resident;
+    return resident * size_t(sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+}
+
+void set_background_priority()
+{
+#ifdef _WIN32
+    SetThreadPriority(GetCurrentThread(), THREAD_MODE_BACKGROUND_BEGIN);
+#elif defined __linux__
+    // on linux, these apply to the calling thread only
+    pid_t const tid = static_cast<pid_t>(syscall(SYS_gettid));
+    int const ioprio_class_idle = 3;
+    int const ioprio_class_shift = 13;
+    int const ioprio_who_process = 1;
+    syscall(SYS_ioprio_set, ioprio_who_process, tid, ioprio_class_idle << ioprio_class_shift);
+    setpriority(PRIO_PROCESS, tid, 19);
+#endif
+}
+
+file_lock_t::file_lock_t(std::filesystem::path const& path)
+    : m_locked(false)
+{
+#ifdef _WIN32
+    HANDLE const handle = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        throw std::runtime_error("Cannot open lock file '" + path.string() + "'");
+    }
+    m_handle = reinterpret_cast<intptr_t>(handle);
+#else
+    int const fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Cannot open lock file '" + path.string() + "': " + std::strerror(errno));
+    }
+    m_handle = fd;
+#endif
+}
+
+file_lock_t::~file_lock_t()
+{
+    unlock();
+#ifdef _WIN32
+    CloseHandle(reinterpret_cast<HANDLE>(m_handle));
+#else
+    close(static_cast<int>(m_handle));
+#endif
+}
+
+bool file_lock_t::try_lock()
+{
+    if (!m_locked)
+    {
+#ifdef _WIN32
+        OVERLAPPED overlapped = { 0 };
+        m_locked = LockFileEx(reinterpret_cast<HANDLE>(m_handle),
+            LOCKFILE_EXCLUSIVE_LOCK | LOCKFILE_FAIL_IMMEDIATELY, 0, MAXDWORD, MAXDWORD, &overlapped) != 0;
+#else
+        m_locked = flock(static_cast<int>(m_handle), LOCK_EX | LOCK_NB) == 0;
+#endif
+    }
+    return m_locked;
+}
+
+void file_lock_t::lock()
+{
+    if (!m_locked)
+    {
+#ifdef _WIN32
+        OVERLAPPED overlapped = { 0 };
+        if (!LockFileEx(reinterpret_cast<HANDLE>(m_handle), LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD, &overlapped))
+        {
+            throw std::runtime_error("Cannot lock file");
+        }
+#else
+        int ret;
+        while (((ret = flock(static_cast<int>(m_handle), LOCK_EX)) != 0) && (errno == EINTR));
+        if (ret != 0)
+        {
+            throw std::runtime_error(std::string("Cannot lock file: ") + std::strerror(errno));
+        }
+#endif
+        m_locked = true;
+    }
+}
+
+void file_lock_t::unlock()
+{
+    if (m_locked)
+    {
+#ifdef _WIN32
+        OVERLAPPED overlapped = { 0 };
+        UnlockFileEx(reinterpret_cast<HANDLE>(m_handle), 0, MAXDWORD, MAXDWORD, &overlapped);
+#else
+        flock(static_cast<int>(m_handle), LOCK_UN);
+#endif
+        m_locked = false;
+    }
+}
+
+bool get_file_stat(std::filesystem::path const& path, file_stat_t& stat)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExW(path.c_str(), GetFileExInfoStandard, &attributes))
+    {
+        return false;
+    }
+    // in 100 ns since 1601
+    int64_t const ticks = (int64_t(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+    int64_t const ticks_to_1970 = 116444736000000000ll;
+    stat.m_size = (uint64_t(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+    stat.m_mtime_seconds = (ticks - ticks_to_1970) / 10000000;
+    stat.m_mtime_nanoseconds = static_cast<uint32_t>((ticks - ticks_to_1970) % 10000000) * 100;
+    return true;
+#else
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0)
+    {
+        return false;
+    }
+    stat.m_size = static_cast<uint64_t>(st.st_size);
+    stat.m_mtime_seconds = static_cast<int64_t>(st.st_mtime);
+#ifdef __APPLE__
+    stat.m_mtime_nanoseconds = static_cast<uint32_t>(st.st_mtimespec.tv_nsec);
+#else
+    stat.m_mtime_nanoseconds = static_cast<uint32_t>(st.st_mtim.tv_nsec);
+#endif
+    return true;
+#endif
+}
+
+mapped_file_t::mapped_file_t(std::filesystem::path const& path)
+    : m_data(nullptr)
+    , m_size(0)
+{
+#ifdef _WIN32
+    HANDLE const file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        throw std::runtime_error("Cannot open '" + path.string() + "'");
+    }
+    std::unique_ptr<void, decltype(&::CloseHandle)> file_guard(file, &::CloseHandle);
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size))
+    {
+        throw std::runtime_error("Cannot read the size of '" + path.string() + "'");
+    }
+    if (size.QuadPart == 0)
+    {
+        return;
+    }
+    HANDLE const mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (!mapping)
+    {
+        throw std::runtime_error("Cannot map '" + path.string() + "'");
+    }
+    std::unique_ptr<void, decltype(&::CloseHandle)> mapping_guard(mapping, &::CloseHandle);
+    m_data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!m_data)
+    {
+        throw std::runtime_error("Cannot map '" + path.string() + "'");
+    }
+    m_size = static_cast<size_t>(size.QuadPart);
+#else
+    int const fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        throw std::runtime_error("Cannot open '" + path.string() + "': " + std::strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        throw std::runtime_error("Cannot read the size of '" + path.string() + "': " + std::strerror(errno));
+    }
+    if (st.st_size > 0)
+    {
+        void* const data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            close(fd);
+            throw std::runtime_error("Cannot map '" + path.string() + "': " + std::strerror(errno));
+        }
+        madvise(data, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+        m_data = data;
+        m_size = static_cast<size_t>(st.st_size);
+    }
+    close(fd);
+#endif
+}
+
+mapped_file_t::~mapped_file_t()
+{
+    if (m_data)
+    {
+#ifdef _WIN32
+        UnmapViewOfFile(m_data);
+#else
+        munmap(m_data, m_size);
+#endif
+    }
+}
+
+bool is_slow_media(std::filesystem::path const& path)
+{
+#ifdef _WIN32
+    wchar_t volume[MAX_PATH + 1];
+    if (!GetVolumePathNameW(std::filesystem::absolute(path).c_str(), volume, MAX_PATH + 1))
+    {
+        return false;
+    }
+    UINT const type = GetDriveTypeW(volume);
+    return (type == DRIVE_REMOVABLE) || (type == DRIVE_REMOTE) || (type == DRIVE_CDROM);
+#elif defined __linux__
+    struct statfs fs;
+    if (statfs(path.c_str(), &fs) != 0)
+    {
+        return false;
+    }
+    // nfs, smb, cifs, smb2 and fuse, e.g. sshfs
+    switch (static_cast<unsigned long>(fs.f_type))
+    {
+    case 0x6969ul:
+    case 0x517Bul:
+    case 0xFF534D42ul:
+    case 0xFE534D42ul:
+    case 0x65735546ul:
+        return true;
+    default:
+        break;
+    }
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+    {
+        return false;
+    }
+    std::error_code error;
+    std::filesystem::path device = std::filesystem::canonical(
+        "/sys/dev/block/" + std::to_string(major(st.st_dev)) + ':' + std::to_string(minor(st.st_dev)), error);
+    if (error)
+    {
+        return false;
+    }
+    // the attributes are those of the disk, not of its partitions
+    if (std::filesystem::exists(device / "partition"))
+    {
+        device = device.parent_path();
+    }
+    auto read_flag = [&](std::filesystem::path const& attribute)
+    {
+        int flag = 0;
+        std::ifstream(device / attribute) >> flag;
+        return flag != 0;
+    };
+    return read_flag("removable") || read_flag(std::filesystem::path("queue") / "rotational");
+#else
+    return false;
+#endif
+}
+
+uint64_t get_device_id(std::filesystem::path const& path)
+{
+#ifdef _WIN32
+    wchar_t volume[MAX_PATH + 1];
+    DWORD serial = 0;
+    if (GetVolumePathNameW(std::filesystem::absolute(path).c_str(), volume, MAX_PATH + 1))
+    {
+        GetVolumeInformationW(volume, NULL, 0, &serial, NULL, NULL, NULL, 0);
+    }
+    return serial;
+#else
+    struct stat st;
+    return (stat(path.c_str(), &st) == 0) ? static_cast<uint64_t>(st.st_dev) : 0;
+#endif
+}
+
+void read_ahead(std::filesystem::path const& path, size_t buffer_size)
+{
+    std::vector<char> buffer(buffer_size);
+#ifdef _WIN32
+    HANDLE const file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+    std::unique_ptr<void, decltype(&::CloseHandle)> file_guard(file, &::CloseHandle);
+    DWORD read = 0;
+    while (ReadFile(file, buffer.data(), static_cast<DWORD>(buffer.size()), &read, NULL) && (read > 0));
+#else
+    int const fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return;
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+#endif
+    ssize_t read_size;
+    while (((read_size = read(fd, buffer.data(), buffer.size())) > 0) || ((read_size < 0) && (errno == EINTR)));
+    close(fd);
+#endif
+}
+
+std::filesystem::path get_lock_path(std::filesystem::path const& repo_path)
+{
+    return repo_path.parent_path() / ("." + repo_path.filename().string() + ".lock");
+}
+
+std::vector<std::string> get_make_command(std::filesystem::path const& repo_dir)
+{
+#ifdef _WIN32
+    return { "cmd.exe", "/d", "/c", "make.cmd" };
+#else
+    return { (repo_dir / "make.sh").string() };
+#endif
+}
+
 }; // namespace repo
@@ -1,12 +1,123 @@
 #ifndef REPO_PLATFORM_SPECIFIC
 #define REPO_PLATFORM_SPECIFIC
 
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
 namespace repo
 {
 
 void set_stdin_echo(bool enable);
 char const* get_username();
 
+// Starts 'args' in 'working_dir' without a shell, with stdout and stderr
+// written to the given files, and waits for it. Returns the exit status.
+// 'environment' holds NAME=value variables which the child gets in
+// addition to, or instead of, those of this process.
+int spawn_and_wait(
+    std::vector<std::string> const& args,
+    std::filesystem::path const& working_dir,
+    std::filesystem::path const& stdout_path,
+    std::filesystem::path const& stderr_path,
+    std::vector<std::string> const& environment);
+
+// A pool of tokens shared with child processes the way GNU make shares its
+// jobs: this process takes a token for every job it starts, and make in
+// such a job takes further tokens for its own parallel jobs, so that all
+// of them together run at most 'jobs' jobs
+class jobserver_t
+{
+public:
+    explicit jobserver_t(unsigned jobs);
+    ~jobserver_t();
+    jobserver_t(jobserver_t const&) = delete;
+    jobserver_t& operator=(jobserver_t const&) = delete;
+    // Blocks until a token is free
+    void acquire();
+    void release();
+    // The MAKEFLAGS with which make in a child process joins the pool
+    std::string makeflags() const;
+private:
+    unsigned m_jobs;
+    // the semaphore on windows, else the read and write ends of the pipe
+    intptr_t m_handles[2];
+    std::string m_name;
+};
+
+// Returns 0 when unknown
+size_t get_physical_memory();
+size_t get_resident_memory();
+
+// Lowers the CPU and I/O priority of the calling thread
+void set_background_priority();
+
+// An advisory lock on a file, which is created if missing, held exclusively
+// while locked. Other processes, and other instances in this process,
+// cooperating on the same file block in lock() until it is unlocked.
+class file_lock_t
+{
+public:
+    explicit file_lock_t(std::filesystem::path const& path);
+    ~file_lock_t();
+    file_lock_t(file_lock_t const&) = delete;
+    file_lock_t& operator=(file_lock_t const&) = delete;
+    bool try_lock();
+    void lock();
+    void unlock();
+private:
+    intptr_t m_handle;
+    bool m_locked;
+};
+
+// The size and modification time of a file as git records them in the
+// index, i.e. with the time in seconds and nanoseconds since 1970
+struct file_stat_t
+{
+    uint64_t m_size = 0;
+    int64_t m_mtime_seconds = 0;
+    uint32_t m_mtime_nanoseconds = 0;
+};
+
+// Returns false when 'path' cannot be read
+bool get_file_stat(std::filesystem::path const& path, file_stat_t& stat);
+
+// A file mapped read-only into memory for sequential reading; empty files
+// are not mapped and have no data
+class mapped_file_t
+{
+public:
+    explicit mapped_file_t(std::filesystem::path const& path);
+    ~mapped_file_t();
+    mapped_file_t(mapped_file_t const&) = delete;
+    mapped_file_t& operator=(mapped_file_t const&) = delete;
+    void const* data() const { return m_data; }
+    size_t size() const { return m_size; }
+private:
+    void* m_data;
+    size_t m_size;
+};
+
+// True for removable, rotational or network storage, where random reads
+// are slow; false when unknown
+bool is_slow_media(std::filesystem::path const& path);
+
+// Identifies the device, or volume, which holds 'path'
+uint64_t get_device_id(std::filesystem::path const& path);
+
+// Reads the file in 'path' from start to end in chunks of 'buffer_size',
+// hinting the system to read ahead, which leaves it in the file cache.
+// Only a hint, so a file which cannot be read is skipped.
+void read_ahead(std::filesystem::path const& path, size_t buffer_size);
+
+// The lock file of the repository in 'repo_path', a hidden file next to it,
+// which is held while the repository is synced or maintained
+std::filesystem::path get_lock_path(std::filesystem::path const& repo_path);
+
+// The command which runs the make script of a repository in 'repo_dir'
+std::vector<std::string> get_make_command(std::filesystem::path const& repo_dir);
+
 }; // namespace repo
 
 #endif // REPO_PLATFORM_SPECIFIC
\ No newline at end of file
@@ -1,16 +1,119 @@
 #include "repo/repo.h"
+#include "repo_options.h"
 #include <iostream>
 #include <stdexcept>
 #include <string>
 #include <sstream>
 #include <memory>
 #include <filesystem>
+#include <mutex>
+#include <fstream>
+#include <map>
+#include <tuple>
 #include "git2/git2.h"
 #include "parse_ssh_config.h"
+#include "platform_specific.h"
+#include "archive_io.h"
+#include "pack_indexer_backend.h"
 
 namespace // anonymous
 {
 
+// Serializes writes to a stream shared by concurrent get() calls
+class output_t
+{
+public:
+    output_t(std::mutex& mutex, std::ostream& os)
+        : m_lock(mutex)
+        , m_os(os)
+    {}
+    template <typename value_t>
+    output_t& operator<<(value_t const& value)
+    {
+        m_os << value;
+        return *this;
+    }
+    output_t& operator<<(std::ostream& (*manipulator)(std::ostream&))
+    {
+        m_os << manipulator;
+        return *this;
+    }
+private:
+    std::lock_guard<std::mutex> m_lock;
+    std::ostream& m_os;
+};
+
+// Transport policies of repo_impl_t::get(): the type of the references
+// they sync, how these make the URL to clone from, how libgit2 clones
+// local URLs and which user authenticates. A new transport, e.g. a bundle
+// or a mirror, adds a policy to transports_t.
+struct file_transport_t
+{
+    typedef repo::gitfile_repo_ref_t repo_ref_t;
+    static constexpr git_clone_local_t clone_local = GIT_CLONE_LOCAL;
+    // the archive is read from the file system, which partial clones borrow
+    // objects from and which may be slow media
+    static constexpr bool local_archive = true;
+    static std::string url(repo_ref_t const& repo_ref)
+    {
+        std::stringstream url;
+        // e.g. file://../../../procts_repo/git/7594fed3a30c4c7b87eb614d30e71cf9
+        url << "file:///" << repo_ref.m_host << '/';
+        url << (repo_ref.m_subdir ? repo_ref.m_subdir : "");
+        url << repo_ref.m_remote_name;
+        return url.str();
+    }
+    static char const* user(repo_ref_t const&)
+    {
+        return nullptr;
+    }
+};
+
+struct ssh_transport_t
+{
+    typedef repo::gitssh_repo_ref_t repo_ref_t;
+    static constexpr git_clone_local_t clone_local = GIT_CLONE_LOCAL_AUTO;
+    static constexpr bool local_archive = false;
+    static std::string url(repo_ref_t const& repo_ref)
+    {
+        std::stringstream url;
+        // e.g. git@github.com:libgit2/libgit2.git
+        url << user(repo_ref) << '@' << repo_ref.m_host << ':';
+        url << (repo_ref.m_subdir ? repo_ref.m_subdir : "");
+        url << repo_ref.m_remote_name;
+        return url.str();
+    }
+    // authenticates with the ssh keys of the host, as this user
+    static char const* user(repo_ref_t const& repo_ref)
+    {
+        return repo_ref.m_gituser ? repo_ref.m_gituser : "git";
+    }
+};
+
+struct https_transport_t
+{
+    typedef repo::githttps_repo_ref_t repo_ref_t;
+    static constexpr git_clone_local_t clone_local = GIT_CLONE_LOCAL;
+    static constexpr bool local_archive = false;
+    static std::string url(repo_ref_t const& repo_ref)
+    {
+        std::stringstream url;
+        // e.g. https://github.com/libgit2/libgit2.git
+        url << "https://" << repo_ref.m_host << '/';
+        url << (repo_ref.m_subdir ? repo_ref.m_subdir : "");
+        url << repo_ref.m_remote_name;
+        return url.str();
+    }
+    // asks for user and password
+    static char const* user(repo_ref_t const&)
+    {
+        return nullptr;
+    }
+};
+
+// In the order in which references are matched
+typedef std::tuple<file_transport_t, ssh_transport_t, https_transport_t> transports_t;
+
 struct repo_impl_t
     : repo::repo_t
 {
@@ -19,6 +122,12 @@ public:
         : m_os(os)
         , m_is(is)
         , m_ask_pwd_user(ask_pwd_user)
+        , m_line_progress(false)
+        , m_partial_clone(false)
+        , m_worktrees(false)
+        , m_archive_readers(0)
+        , m_index_threads(0)
+        , m_index_cache_size(0)
     {
         git_libgit2_init();
     }
@@ -31,19 +140,7 @@ public:
         char const* path,
         char const* dirname) override
     {
-        if (repo::gitfile_repo_ref_t const* pref = dynamic_cast<repo::gitfile_repo_ref_t const*>(&repo_ref))
-        {
-            get(*pref, path, dirname);
-        }
-        else if (repo::gitssh_repo_ref_t const* pref = dynamic_cast<repo::gitssh_repo_ref_t const*>(&repo_ref))
-        {
-            get(*pref, path, dirname);
-        }
-        else if (repo::githttps_repo_ref_t const* pref = dynamic_cast<repo::githttps_repo_ref_t const*>(&repo_ref))
-        {
-            get(*pref, path, dirname);
-        }
-        else
+        if (!get(static_cast<transports_t*>(nullptr), repo_ref, path, dirname))
         {
             throw std::logic_error("Unsupported repository reference");
         }
@@ -65,9 +162,89 @@ public:
         check(ret);
         return true;
     }
+    void set_options(repo::sync_options_t const& options)
+    {
+        m_line_progress = options.m_line_progress;
+        m_partial_clone = options.m_partial_clone;
+        m_worktrees = options.m_worktrees;
+        m_archive_readers = options.m_archive_readers;
+        m_index_threads = options.m_index_threads;
+        m_index_cache_size = options.m_index_cache_size;
+    }
 protected:
+    enum class fetch_state_t
+    {
+        start_count_objects,
+        count_objects,
+        start_count_deltas,
+        count_deltas,
+        ready
+    };
+    enum class checkout_state_t
+    {
+        start,
+        count,
+        ready
+    };
+    // State of one get(), several of which may run concurrently
+    struct sync_t
+    {
+        sync_t(repo_impl_t& repo, char const* name)
+            : m_repo(repo)
+            , m_name(name)
+            , m_user(nullptr)
+            , m_fetch_state(fetch_state_t::start_count_objects)
+            , m_checkout_state(checkout_state_t::start)
+            , m_reported_percent(0)
+        {}
+        repo_impl_t& m_repo;
+        std::string m_name;
+        identities_t m_identities;
+        identities_t::const_iterator m_pidentity;
+        char const* m_user;
+        fetch_state_t m_fetch_state;
+        checkout_state_t m_checkout_state;
+        size_t m_reported_percent;
+    };
+    // The identities for a host, parsed from the ssh configuration once
+    identities_t identities(char const* host)
+    {
+        std::lock_guard<std::mutex> lock(m_identities_mutex);
+        std::map<std::string, identities_t>::const_iterator pidentities = m_identities.find(host);
+        if (pidentities == m_identities.end())
+        {
+            identities_t identities;
+            find_identities(host, identities);
+            pidentities = m_identities.emplace(host, identities).first;
+        }
+        return pidentities->second;
+    }
+    output_t out()
+    {
+        return output_t(m_os_mutex, m_os);
+    }
+    // Syncs with the first transport whose reference type 'repo_ref' has,
+    // i.e. is or derives from; returns false when no transport matches
+    template <typename... transport_t>
+    bool get(std::tuple<transport_t...>*, repo::repo_ref_t const& repo_ref, char const* path, char const* dirname)
+    {
+        return (get_as<transport_t>(repo_ref, path, dirname) || ...);
+    }
+    template <typename transport_t>
+    bool get_as(repo::repo_ref_t const& repo_ref, char const* path, char const* dirname)
+    {
+        typename transport_t::repo_ref_t const* pref = dynamic_cast<typename transport_t::repo_ref_t const*>(&repo_ref);
+        if (pref)
+        {
+            get<transport_t>(*pref, path, dirname);
+        }
+        return pref != nullptr;
+    }
+    // Clones, or fetches, the repository and checks out its branch, or
+    // commit, and its submodules, the same for all transports
+    template <typename transport_t>
     void get(
-        repo::gitfile_repo_ref_t const& repo_ref,
+        typename transport_t::repo_ref_t const& repo_ref,
         char const* path,
         char const* dirname)
     {
@@ -83,43 +260,94 @@ protected:
         {
             throw std::logic_error("No local name in repository reference defined");
         }
-        find_identities(repo_ref.m_host, m_identities);
-        m_pidentity = m_identities.begin();
+        sync_t sync(*this, dirname ? dirname : repo_ref.m_local_name);
+        sync.m_identities = identities(repo_ref.m_host);
+        sync.m_pidentity = sync.m_identities.begin();
+        sync.m_user = transport_t::user(repo_ref);
         git_repository *repo = NULL;
         std::unique_ptr<git_repository, decltype(&::git_repository_free)>
             repo_guard(repo, &::git_repository_free);
         git_clone_options clone_options = GIT_CLONE_OPTIONS_INIT;
         clone_options.fetch_opts.callbacks.transfer_progress = fetch_progress;
         clone_options.fetch_opts.callbacks.credentials = credentials_cb;
-        clone_options.fetch_opts.callbacks.payload = this;
+        clone_options.fetch_opts.callbacks.payload = &sync;
         if (repo_ref.m_commit_sha)
         {
             clone_options.checkout_opts.checkout_strategy = GIT_CHECKOUT_NONE;
         }
         clone_options.checkout_opts.progress_cb = checkout_progress;
-        clone_options.checkout_opts.progress_payload = this;
+        clone_options.checkout_opts.progress_payload = &sync;
         clone_options.checkout_branch = repo_ref.m_branch;
-        clone_options.local = GIT_CLONE_LOCAL;
-        m_fetch_state = fetch_state_t::start_count_objects;
-        m_checkout_state = checkout_state_t::start;
+        clone_options.local = transport_t::clone_local;
+        if (m_index_threads)
+        {
+            clone_options.repository_cb = create_repository;
+            clone_options.repository_cb_payload = this;
+        }
         std::filesystem::path fullpath(path);
         fullpath /= (dirname ? dirname : repo_ref.m_local_name);
-        if (!std::filesystem::exists(fullpath))
-        {
-            m_os << "Cloning into '" << fullpath << "'..." << std::endl;
-            std::stringstream url;
-            // e.g. file://../../../procts_repo/git/7594fed3a30c4c7b87eb614d30e71cf9
-            url << "file:///" << repo_ref.m_host << '/';
-            url << (repo_ref.m_subdir ? repo_ref.m_subdir : "");
-            url << repo_ref.m_remote_name;
-            check(git_clone(&repo, url.str().c_str(), fullpath.string().c_str(), &clone_options));
+        repo::file_lock_t sync_lock(repo::get_lock_path(fullpath));
+        lock(sync_lock, fullpath);
+        // a working tree attaches to the clone in 'primary', whose lock is
+        // taken before the archive device, in the order of a sync of the
+        // clone itself, which would deadlock with this one otherwise
+        std::filesystem::path const primary = std::filesystem::path(path) / repo_ref.m_local_name;
+        std::unique_ptr<repo::file_lock_t> primary_lock;
+        if (!std::filesystem::exists(fullpath) && may_attach_worktree(primary, fullpath, repo_ref.m_branch))
+        {
+            primary_lock = std::make_unique<repo::file_lock_t>(repo::get_lock_path(primary));
+            lock(*primary_lock, primary);
+        }
+        std::filesystem::path archive;
+        std::unique_ptr<repo::device_reader_t> archive_reader;
+        if constexpr (transport_t::local_archive)
+        {
+            archive = repo_ref.m_host;
+            archive /= std::string(repo_ref.m_subdir ? repo_ref.m_subdir : "") + repo_ref.m_remote_name;
+            if (m_archive_readers && repo::is_slow_media(archive))
+            {
+                archive_reader = std::make_unique<repo::device_reader_t>(m_device_readers, repo::get_device_id(archive), m_archive_readers);
+            }
+        }
+        if (primary_lock && attach_worktree(&repo, primary, fullpath, repo_ref.m_branch, clone_options))
+        {
+            repo_guard.reset(repo);
+            release_archive(archive_reader, repo);
+        }
+        else if (!std::filesystem::exists(fullpath))
+        {
+            out() << "Cloning into '" << fullpath << "'..." << std::endl;
+            std::string const url = transport_t::url(repo_ref);
+            if (transport_t::local_archive && m_partial_clone)
+            {
+                clone_atomically(&repo, fullpath, [&](git_repository** out, std::filesystem::path const& target)
+                {
+                    clone_shared(out, url, archive, target, repo_ref.m_branch, clone_options);
+                });
+            }
+            else
+            {
+                if (archive_reader)
+                {
+                    // a quarter of the memory leaves room for the clone itself
+                    repo::read_packs_ahead(archive, repo::get_physical_memory() / 4);
+                }
+                clone_atomically(&repo, fullpath, [&](git_repository** out, std::filesystem::path const& target)
+                {
+                    check(git_clone(out, url.c_str(), target.string().c_str(), &clone_options));
+                });
+            }
             repo_guard.reset(repo);
+            release_archive(archive_reader, repo);
         }
         else
         {
-            m_os << "Fetching '" << fullpath << "'..." << std::endl;
-            check(git_repository_init(&repo, fullpath.string().c_str(), false));
+            out() << "Fetching '" << fullpath << "'..." << std::endl;
+            // opening, unlike initializing, follows the .git file of a
+            // linked working tree
+            check(git_repository_open(&repo, fullpath.string().c_str()));
             repo_guard.reset(repo);
+            index_packs(repo);
             git_remote *remote = NULL;
             std::unique_ptr<git_remote, decltype(&::git_remote_free)>
                 remote_guard(remote, &::git_remote_free);
@@ -129,6 +357,8 @@ protected:
                 NULL, /* refspecs, NULL to use the configured ones */
                 &clone_options.fetch_opts, /* options, empty for defaults */
                 NULL)); /* reflog mesage, usually "fetch" or "pull", you can leave it NULL for "fetch" */
+            release_archive(archive_reader, repo);
+            update_worktrees(repo);
             if (!repo_ref.m_commit_sha)
             {
                 git_config *snap_cfg = NULL;
@@ -157,255 +387,470 @@ protected:
             clone_options.checkout_opts.checkout_strategy = GIT_CHECKOUT_FORCE;
             check(git_checkout_head(repo, &clone_options.checkout_opts));
         }
-        m_os << "Update submodules" << std::endl;
-        check(git_submodule_foreach(repo, update_submodule, this));
+        if (is_shared(repo))
+        {
+            hydrate_head(repo);
+        }
+        archive_reader.reset();
+        out() << "Update submodules of '" << fullpath << "'" << std::endl;
+        check(git_submodule_foreach(repo, update_submodule, &sync));
         if (repo_ref.m_commit_user)
         {
-            git_config *cfg = NULL;
-            std::unique_ptr<git_config, decltype(&::git_config_free)>
-                cfg_guard(cfg, &::git_config_free);
-            check(git_config_open_default(&cfg));
-            cfg_guard.reset(cfg);
-            git_config *global_cfg = NULL;
-            std::unique_ptr<git_config, decltype(&::git_config_free)>
-                global_cfg_guard(global_cfg, &::git_config_free);
-            check(git_config_open_level(&global_cfg, cfg, GIT_CONFIG_LEVEL_GLOBAL));
-            global_cfg_guard.reset(global_cfg);
-            check(git_config_set_string(global_cfg, "user.name", repo_ref.m_commit_user));
+            set_commit_user(repo_ref.m_commit_user);
         }
     }
-    void get(
-        repo::gitssh_repo_ref_t const& repo_ref,
-        char const* path,
-        char const* dirname)
+    // Resolves the deltas of the packs which are fetched into 'repo' on
+    // several threads, when configured
+    void index_packs(git_repository* repo)
     {
-        if (!repo_ref.m_host)
+        if (m_index_threads)
         {
-            throw std::logic_error("No host in repository reference defined");
+            repo::add_pack_indexer(repo, m_index_threads, m_index_cache_size);
         }
-        if (!repo_ref.m_remote_name)
+    }
+    // Creates the repository which git_clone() fetches into
+    static int create_repository(git_repository** out, char const* path, int bare, void* payload)
+    {
+        int error = git_repository_init(out, path, bare);
+        if (error < 0)
         {
-            throw std::logic_error("No remote name in repository reference defined");
+            return error;
         }
-        if (!repo_ref.m_local_name)
+        try
         {
-            throw std::logic_error("No local name in repository reference defined");
+            static_cast<repo_impl_t*>(payload)->index_packs(*out);
         }
-        find_identities(repo_ref.m_host, m_identities);
-        m_pidentity = m_identities.begin();
-        git_repository *repo = NULL;
-        std::unique_ptr<git_repository, decltype(&::git_repository_free)>
-            repo_guard(repo, &::git_repository_free);
-        git_clone_options clone_options = GIT_CLONE_OPTIONS_INIT;
-        clone_options.fetch_opts.callbacks.transfer_progress = fetch_progress;
-        clone_options.fetch_opts.callbacks.credentials = credentials_cb;
-        clone_options.fetch_opts.callbacks.payload = this;
-        if (repo_ref.m_commit_sha)
+        catch (std::exception const& e)
         {
-            clone_options.checkout_opts.checkout_strategy = GIT_CHECKOUT_NONE;
+            giterr_set_str(GITERR_INDEXER, e.what());
+            git_repository_free(*out);
+            *out = NULL;
+            return -1;
         }
-        clone_options.checkout_opts.progress_cb = checkout_progress;
-        clone_options.checkout_opts.progress_payload = this;
-        clone_options.checkout_branch = repo_ref.m_branch;
-        m_fetch_state = fetch_state_t::start_count_objects;
-        m_checkout_state = checkout_state_t::start;
-        std::filesystem::path fullpath(path);
-        fullpath /= (dirname ? dirname : repo_ref.m_local_name);
-        m_user = repo_ref.m_gituser ? repo_ref.m_gituser : "git";
-        if (!std::filesystem::exists(fullpath))
-        {
-            m_os << "Cloning into '" << fullpath << "'..." << std::endl;
-            std::stringstream url;
-            // e.g. git@github.com:libgit2/libgit2.git
-            url << m_user << '@' << repo_ref.m_host << ':';
-            url << (repo_ref.m_subdir ? repo_ref.m_subdir : "");
-            url << repo_ref.m_remote_name;
-            check(git_clone(&repo, url.str().c_str(), fullpath.string().c_str(), &clone_options));
-            repo_guard.reset(repo);
+        return 0;
+    }
+    // The path of a hidden file or directory next to 'fullpath'
+    static std::filesystem::path sibling(std::filesystem::path const& fullpath, char const* suffix)
+    {
+        return fullpath.parent_path() / ("." + fullpath.filename().string() + suffix);
+    }
+    // Locks the repository in 'fullpath' against concurrent syncs by other
+    // processes, which wait for each other and then reuse the result
+    void lock(repo::file_lock_t& sync_lock, std::filesystem::path const& fullpath)
+    {
+        if (!sync_lock.try_lock())
+        {
+            out() << "Waiting for another process syncing '" << fullpath << "'..." << std::endl;
+            sync_lock.lock();
+        }
+    }
+    // Clones into a temporary directory next to 'fullpath' that is renamed
+    // when the clone is complete, so that an interrupted clone never leaves
+    // a partial repository behind, which would be fetched into next time
+    template <typename clone_fn_t>
+    void clone_atomically(git_repository** out, std::filesystem::path const& fullpath, clone_fn_t clone)
+    {
+        std::filesystem::path const temp = sibling(fullpath, ".clone");
+        std::filesystem::remove_all(temp);
+        git_repository *repo = NULL;
+        clone(&repo, temp);
+        git_repository_free(repo);
+        std::filesystem::rename(temp, fullpath);
+        check(git_repository_open(out, fullpath.string().c_str()));
+    }
+    // The lock next to the global configuration, also when that is not
+    // created yet, as on a fresh machine, where concurrent runs all write it
+    static std::filesystem::path global_config_lock_path()
+    {
+        git_buf global_path = { 0 };
+        std::filesystem::path lock_path;
+        if (git_config_find_global(&global_path) == 0)
+        {
+            lock_path = std::string(global_path.ptr) + ".flying_start.lock";
         }
         else
         {
-            m_os << "Fetching '" << fullpath << "'..." << std::endl;
-            check(git_repository_init(&repo, fullpath.string().c_str(), false));
-            repo_guard.reset(repo);
-            git_remote *remote = NULL;
-            std::unique_ptr<git_remote, decltype(&::git_remote_free)>
-                remote_guard(remote, &::git_remote_free);
-            check(git_remote_lookup(&remote, repo, "origin"));
-            remote_guard.reset(remote);
-            check(git_remote_fetch(remote,
-                NULL, /* refspecs, NULL to use the configured ones */
-                &clone_options.fetch_opts, /* options, empty for defaults */
-                NULL)); /* reflog mesage, usually "fetch" or "pull", you can leave it NULL for "fetch" */
-            if (!repo_ref.m_commit_sha)
+            git_buf_free(&global_path);
+            check(git_libgit2_opts(GIT_OPT_GET_SEARCH_PATH, GIT_CONFIG_LEVEL_GLOBAL, &global_path));
+            std::string const search_path(global_path.ptr ? global_path.ptr : "");
+            std::string const dir = search_path.substr(0, search_path.find(GIT_PATH_LIST_SEPARATOR));
+            if (!dir.empty())
             {
-                git_config *snap_cfg = NULL;
-                std::unique_ptr<git_config, decltype(&::git_config_free)>
-                    snap_cfg_guard(snap_cfg, &::git_config_free);
-                check(git_repository_config_snapshot(&snap_cfg, repo));
-                snap_cfg_guard.reset(snap_cfg);
-                char const* branch_master_merge = NULL;
-                check(git_config_get_string(&branch_master_merge, snap_cfg, "branch.master.merge"));
-                std::string refname(branch_master_merge);
-                if (repo_ref.m_branch)
-                {
-                    size_t  last_slash = refname.find_last_of('/');
-                    refname.replace(last_slash + 1, refname.length() - last_slash - 1, repo_ref.m_branch);
-                }
-                check(git_repository_set_head(repo, refname.c_str()));
-                clone_options.checkout_opts.checkout_strategy = GIT_CHECKOUT_FORCE;
-                check(git_checkout_head(repo, &clone_options.checkout_opts));
+                lock_path = std::filesystem::path(dir) / ".gitconfig.flying_start.lock";
             }
         }
-        if (repo_ref.m_commit_sha)
+        git_buf_free(&global_path);
+        if (lock_path.empty())
         {
-            git_oid commitish;
-            check(git_oid_fromstr(&commitish, repo_ref.m_commit_sha));
-            check(git_repository_set_head_detached(repo, &commitish));
-            clone_options.checkout_opts.checkout_strategy = GIT_CHECKOUT_FORCE;
-            check(git_checkout_head(repo, &clone_options.checkout_opts));
+            throw std::runtime_error("Cannot locate the global git configuration");
         }
-        m_os << "Update submodules" << std::endl;
-        check(git_submodule_foreach(repo, update_submodule, this));
-        if (repo_ref.m_commit_user)
+        return lock_path;
+    }
+    // Sets the global user.name, which all processes on the host share, so
+    // it is written under a lock next to the global configuration and only
+    // if it differs
+    void set_commit_user(char const* commit_user)
+    {
+        std::lock_guard<std::mutex> lock(m_config_mutex);
+        repo::file_lock_t config_lock(global_config_lock_path());
+        config_lock.lock();
+        git_config *cfg = NULL;
+        std::unique_ptr<git_config, decltype(&::git_config_free)>
+            cfg_guard(cfg, &::git_config_free);
+        check(git_config_open_default(&cfg));
+        cfg_guard.reset(cfg);
+        git_config *global_cfg = NULL;
+        std::unique_ptr<git_config, decltype(&::git_config_free)>
+            global_cfg_guard(global_cfg, &::git_config_free);
+        check(git_config_open_level(&global_cfg, cfg, GIT_CONFIG_LEVEL_GLOBAL));
+        global_cfg_guard.reset(global_cfg);
+        git_buf user_name = { 0 };
+        bool const same = (git_config_get_string_buf(&user_name, global_cfg, "user.name") == 0) &&
+            (std::string(user_name.ptr) == commit_user);
+        git_buf_free(&user_name);
+        if (!same)
         {
-            git_config *cfg = NULL;
-            std::unique_ptr<git_config, decltype(&::git_config_free)>
-                cfg_guard(cfg, &::git_config_free);
-            check(git_config_open_default(&cfg));
-            cfg_guard.reset(cfg);
-            git_config *global_cfg = NULL;
-            std::unique_ptr<git_config, decltype(&::git_config_free)>
-                global_cfg_guard(global_cfg, &::git_config_free);
-            check(git_config_open_level(&global_cfg, cfg, GIT_CONFIG_LEVEL_GLOBAL));
-            global_cfg_guard.reset(global_cfg);
-            check(git_config_set_string(global_cfg, "user.name", repo_ref.m_commit_user));
+            check(git_config_set_string(global_cfg, "user.name", commit_user));
         }
     }
-    void get(
-        repo::githttps_repo_ref_t const& repo_ref,
-        char const* path,
-        char const* dirname)
+    // Clones without copying the objects of a local archive: the clone
+    // borrows them through objects/info/alternates, so the fetch finds all
+    // wanted objects present and downloads nothing, and the checkout only
+    // reads the blobs of the tree it checks out
+    void clone_shared(
+        git_repository** out,
+        std::string const& url,
+        std::filesystem::path archive,
+        std::filesystem::path const& fullpath,
+        char const* branch,
+        git_clone_options const& clone_options)
     {
-        if (!repo_ref.m_host)
+        archive = std::filesystem::absolute(archive);
+        std::filesystem::path archive_objects = archive / "objects";
+        if (!std::filesystem::is_directory(archive_objects))
         {
-            throw std::logic_error("No host in repository reference defined");
+            archive_objects = archive / ".git" / "objects";
         }
-        if (!repo_ref.m_remote_name)
+        git_repository *repo = NULL;
+        std::unique_ptr<git_repository, decltype(&::git_repository_free)>
+            repo_guard(repo, &::git_repository_free);
+        check(git_repository_init(&repo, fullpath.string().c_str(), false));
+        repo_guard.reset(repo);
         {
-            throw std::logic_error("No remote name in repository reference defined");
+            std::filesystem::path const info = std::filesystem::path(git_repository_path(repo)) / "objects" / "info";
+            std::filesystem::create_directories(info);
+            std::ofstream alternates(info / "alternates", std::ios::trunc);
+            alternates << archive_objects.generic_string() << '\n';
         }
-        if (!repo_ref.m_local_name)
+        // reopen, so the object database picks up the alternates
+        repo = NULL;
+        repo_guard.reset();
+        check(git_repository_open(&repo, fullpath.string().c_str()));
+        repo_guard.reset(repo);
+        index_packs(repo);
+        git_remote *remote = NULL;
+        std::unique_ptr<git_remote, decltype(&::git_remote_free)>
+            remote_guard(remote, &::git_remote_free);
+        check(git_remote_create(&remote, repo, "origin", url.c_str()));
+        remote_guard.reset(remote);
+        check(git_remote_fetch(remote, NULL, &clone_options.fetch_opts, NULL));
+        std::string branch_name(branch ? branch : "");
+        if (!branch)
         {
-            throw std::logic_error("No local name in repository reference defined");
+            // the branch which HEAD of the remote points to, as git_clone()
+            // checks out, e.g. refs/heads/main
+            git_buf default_branch = { 0 };
+            check(git_remote_default_branch(&default_branch, remote));
+            branch_name = default_branch.ptr;
+            git_buf_free(&default_branch);
+            std::string const heads("refs/heads/");
+            if (branch_name.compare(0, heads.size(), heads) == 0)
+            {
+                branch_name.erase(0, heads.size());
+            }
+            git_reference *remote_head = NULL;
+            check(git_reference_symbolic_create(&remote_head, repo, "refs/remotes/origin/HEAD",
+                ("refs/remotes/origin/" + branch_name).c_str(), 1, NULL));
+            git_reference_free(remote_head);
+        }
+        git_object *commit = NULL;
+        std::unique_ptr<git_object, decltype(&::git_object_free)>
+            commit_guard(commit, &::git_object_free);
+        check(git_revparse_single(&commit, repo, ("refs/remotes/origin/" + branch_name + "^{commit}").c_str()));
+        commit_guard.reset(commit);
+        git_reference *local_branch = NULL;
+        std::unique_ptr<git_reference, decltype(&::git_reference_free)>
+            local_branch_guard(local_branch, &::git_reference_free);
+        check(git_branch_create(&local_branch, repo, branch_name.c_str(), reinterpret_cast<git_commit*>(commit), 0));
+        local_branch_guard.reset(local_branch);
+        check(git_branch_set_upstream(local_branch, ("origin/" + branch_name).c_str()));
+        check(git_repository_set_head(repo, git_reference_name(local_branch)));
+        if (clone_options.checkout_opts.checkout_strategy != GIT_CHECKOUT_NONE)
+        {
+            git_checkout_options checkout_opts = clone_options.checkout_opts;
+            checkout_opts.checkout_strategy = GIT_CHECKOUT_SAFE;
+            check(git_checkout_head(repo, &checkout_opts));
+        }
+        *out = repo_guard.release();
+    }
+    // The object database of a linked working tree is that of the
+    // repository it is linked to, in the common directory
+    static bool is_shared(git_repository* repo)
+    {
+        return std::filesystem::exists(std::filesystem::path(git_repository_commondir(repo)) / "objects" / "info" / "alternates");
+    }
+    // Frees the archive device for other syncs once 'repo' has all it
+    // needs from it. A shared clone keeps reading the archive through its
+    // alternates until its HEAD is hydrated.
+    static void release_archive(std::unique_ptr<repo::device_reader_t>& archive_reader, git_repository* repo)
+    {
+        if (!is_shared(repo))
+        {
+            archive_reader.reset();
         }
-        find_identities(repo_ref.m_host, m_identities);
-        m_pidentity = m_identities.begin();
+    }
+    // Whether 'fullpath' may become a working tree of the clone in 'primary'
+    bool may_attach_worktree(std::filesystem::path const& primary, std::filesystem::path const& fullpath, char const* branch) const
+    {
+        return m_worktrees && branch && (fullpath != primary) && std::filesystem::exists(primary);
+    }
+    // Attaches a working tree for 'branch' to the clone of the same remote
+    // in 'primary', which the caller has locked, instead of cloning again,
+    // so that both share one object database. Returns false when this does
+    // not apply, e.g. when the branch is checked out by another working tree
+    // already.
+    bool attach_worktree(
+        git_repository** out,
+        std::filesystem::path const& primary,
+        std::filesystem::path const& fullpath,
+        char const* branch,
+        git_clone_options const& clone_options)
+    {
         git_repository *repo = NULL;
         std::unique_ptr<git_repository, decltype(&::git_repository_free)>
             repo_guard(repo, &::git_repository_free);
-        git_clone_options clone_options = GIT_CLONE_OPTIONS_INIT;
-        clone_options.fetch_opts.callbacks.transfer_progress = fetch_progress;
-        clone_options.fetch_opts.callbacks.credentials = credentials_cb;
-        clone_options.fetch_opts.callbacks.payload = this;
-        if (repo_ref.m_commit_sha)
+        check(git_repository_open(&repo, primary.string().c_str()));
+        repo_guard.reset(repo);
+        index_packs(repo);
+        git_remote *remote = NULL;
+        std::unique_ptr<git_remote, decltype(&::git_remote_free)>
+            remote_guard(remote, &::git_remote_free);
+        check(git_remote_lookup(&remote, repo, "origin"));
+        remote_guard.reset(remote);
+        this->out() << "Fetching '" << primary << "'..." << std::endl;
+        check(git_remote_fetch(remote, NULL, &clone_options.fetch_opts, NULL));
+        git_reference *local_branch = NULL;
+        std::unique_ptr<git_reference, decltype(&::git_reference_free)>
+            local_branch_guard(local_branch, &::git_reference_free);
+        int error = git_branch_lookup(&local_branch, repo, branch, GIT_BRANCH_LOCAL);
+        if (error == GIT_ENOTFOUND)
         {
-            clone_options.checkout_opts.checkout_strategy = GIT_CHECKOUT_NONE;
-        }
-        clone_options.checkout_opts.progress_cb = checkout_progress;
-        clone_options.checkout_opts.progress_payload = this;
-        clone_options.checkout_branch = repo_ref.m_branch;
-        clone_options.local = GIT_CLONE_LOCAL;
-        m_fetch_state = fetch_state_t::start_count_objects;
-        m_checkout_state = checkout_state_t::start;
-        std::filesystem::path fullpath(path);
-        fullpath /= (dirname ? dirname : repo_ref.m_local_name);
-        if (!std::filesystem::exists(fullpath))
-        {
-            m_os << "Cloning into '" << fullpath << "'..." << std::endl;
-            std::stringstream url;
-            // e.g. file://../../../procts_repo/git/7594fed3a30c4c7b87eb614d30e71cf9
-            url << "https://" << repo_ref.m_host << '/';
-            url << (repo_ref.m_subdir ? repo_ref.m_subdir : "");
-            url << repo_ref.m_remote_name;
-            check(git_clone(&repo, url.str().c_str(), fullpath.string().c_str(), &clone_options));
-            repo_guard.reset(repo);
+            std::string const upstream = std::string("origin/") + branch;
+            git_object *commit = NULL;
+            std::unique_ptr<git_object, decltype(&::git_object_free)>
+                commit_guard(commit, &::git_object_free);
+            check(git_revparse_single(&commit, repo, ("refs/remotes/" + upstream + "^{commit}").c_str()));
+            commit_guard.reset(commit);
+            check(git_branch_create(&local_branch, repo, branch, reinterpret_cast<git_commit*>(commit), 0));
+            local_branch_guard.reset(local_branch);
+            check(git_branch_set_upstream(local_branch, upstream.c_str()));
         }
         else
         {
-            m_os << "Fetching '" << fullpath << "'..." << std::endl;
-            check(git_repository_init(&repo, fullpath.string().c_str(), false));
-            repo_guard.reset(repo);
-            git_remote *remote = NULL;
-            std::unique_ptr<git_remote, decltype(&::git_remote_free)>
-                remote_guard(remote, &::git_remote_free);
-            check(git_remote_lookup(&remote, repo, "origin"));
-            remote_guard.reset(remote);
-            check(git_remote_fetch(remote,
-                NULL, /* refspecs, NULL to use the configured ones */
-                &clone_options.fetch_opts, /* options, empty for defaults */
-                NULL)); /* reflog mesage, usually "fetch" or "pull", you can leave it NULL for "fetch" */
-            if (!repo_ref.m_commit_sha)
+            check(error);
+            local_branch_guard.reset(local_branch);
+        }
+        if (git_branch_is_checked_out(local_branch) == 1)
+        {
+            return false;
+        }
+        this->out() << "Adding worktree '" << fullpath << "' to '" << primary << "'..." << std::endl;
+        git_worktree_add_options worktree_add_options = GIT_WORKTREE_ADD_OPTIONS_INIT;
+        worktree_add_options.ref = local_branch;
+        git_worktree *worktree = NULL;
+        std::unique_ptr<git_worktree, decltype(&::git_worktree_free)>
+            worktree_guard(worktree, &::git_worktree_free);
+        check(git_worktree_add(&worktree, repo, fullpath.filename().string().c_str(), fullpath.string().c_str(), &worktree_add_options));
+        worktree_guard.reset(worktree);
+        check(git_repository_open_from_worktree(out, worktree));
+        return true;
+    }
+    // Fast-forwards the branches of the working trees linked to 'repo' to
+    // what was fetched for their upstream, and checks them out; local
+    // changes are kept, unlike with the checkout of the fetching repository.
+    // Working trees which are being synced themselves are left to that sync,
+    // which also avoids waiting for each other's locks.
+    void update_worktrees(git_repository* repo)
+    {
+        std::filesystem::path const workdir = std::filesystem::path(git_repository_workdir(repo)).parent_path();
+        git_strarray names = { 0 };
+        check(git_worktree_list(&names, repo));
+        std::unique_ptr<git_strarray, decltype(&::git_strarray_free)>
+            names_guard(&names, &::git_strarray_free);
+        git_checkout_options checkout_options = GIT_CHECKOUT_OPTIONS_INIT;
+        checkout_options.checkout_strategy = GIT_CHECKOUT_SAFE;
+        for (size_t i = 0; i < names.count; ++i)
+        {
+            git_worktree *worktree = NULL;
+            std::unique_ptr<git_worktree, decltype(&::git_worktree_free)>
+                worktree_guard(worktree, &::git_worktree_free);
+            if (git_worktree_lookup(&worktree, repo, names.strings[i]) < 0)
             {
-                git_config *snap_cfg = NULL;
-                std::unique_ptr<git_config, decltype(&::git_config_free)>
-                    snap_cfg_guard(snap_cfg, &::git_config_free);
-                check(git_repository_config_snapshot(&snap_cfg, repo));
-                snap_cfg_guard.reset(snap_cfg);
-                char const* branch_master_merge = NULL;
-                check(git_config_get_string(&branch_master_merge, snap_cfg, "branch.master.merge"));
-                std::string refname(branch_master_merge);
-                if (repo_ref.m_branch)
-                {
-                    size_t  last_slash = refname.find_last_of('/');
-                    refname.replace(last_slash + 1, refname.length() - last_slash - 1, repo_ref.m_branch);
-                }
-                check(git_repository_set_head(repo, refname.c_str()));
-                clone_options.checkout_opts.checkout_strategy = GIT_CHECKOUT_FORCE;
-                check(git_checkout_head(repo, &clone_options.checkout_opts));
+                continue;
             }
+            worktree_guard.reset(worktree);
+            if (git_worktree_validate(worktree) < 0)
+            {
+                // pruned
+                continue;
+            }
+            git_repository *worktree_repo = NULL;
+            std::unique_ptr<git_repository, decltype(&::git_repository_free)>
+                worktree_repo_guard(worktree_repo, &::git_repository_free);
+            check(git_repository_open_from_worktree(&worktree_repo, worktree));
+            worktree_repo_guard.reset(worktree_repo);
+            std::filesystem::path const worktree_path = std::filesystem::path(git_repository_workdir(worktree_repo)).parent_path();
+            if (worktree_path == workdir)
+            {
+                continue;
+            }
+            repo::file_lock_t worktree_lock(repo::get_lock_path(worktree_path));
+            if (!worktree_lock.try_lock())
+            {
+                continue;
+            }
+            git_reference *head = NULL;
+            std::unique_ptr<git_reference, decltype(&::git_reference_free)>
+                head_guard(head, &::git_reference_free);
+            if ((git_repository_head(&head, worktree_repo) < 0) || (head_guard.reset(head), git_repository_head_detached(worktree_repo) == 1))
+            {
+                continue;
+            }
+            git_reference *upstream = NULL;
+            std::unique_ptr<git_reference, decltype(&::git_reference_free)>
+                upstream_guard(upstream, &::git_reference_free);
+            if (git_branch_upstream(&upstream, head) < 0)
+            {
+                continue;
+            }
+            upstream_guard.reset(upstream);
+            git_oid const* from = git_reference_target(head);
+            git_oid const* to = git_reference_target(upstream);
+            if (git_oid_equal(from, to) || (git_graph_descendant_of(worktree_repo, to, from) != 1))
+            {
+                continue;
+            }
+            out() << "Updating worktree '" << names.strings[i] << "'..." << std::endl;
+            git_reference *updated = NULL;
+            check(git_reference_set_target(&updated, head, to, "fast-forward"));
+            git_reference_free(updated);
+            check(git_checkout_head(worktree_repo, &checkout_options));
         }
-        if (repo_ref.m_commit_sha)
+    }
+    struct hydrate_t
+    {
+        git_odb* m_local_odb;
+        git_packbuilder* m_packbuilder;
+    };
+    static int hydrate_entry(char const* root, git_tree_entry const* entry, void* payload)
+    {
+        hydrate_t* hydrate = static_cast<hydrate_t*>(payload);
+        git_otype const type = git_tree_entry_type(entry);
+        if (type == GIT_OBJ_COMMIT)
         {
-            git_oid commitish;
-            check(git_oid_fromstr(&commitish, repo_ref.m_commit_sha));
-            check(git_repository_set_head_detached(repo, &commitish));
-            clone_options.checkout_opts.checkout_strategy = GIT_CHECKOUT_FORCE;
-            check(git_checkout_head(repo, &clone_options.checkout_opts));
+            // a submodule, hydrated by its own repository
+            return 0;
         }
-        m_os << "Update submodules" << std::endl;
-        check(git_submodule_foreach(repo, update_submodule, this));
-        if (repo_ref.m_commit_user)
+        if (git_odb_exists(hydrate->m_local_odb, git_tree_entry_id(entry)))
+        {
+            // trees are hydrated as a whole, so skip the entries of local trees
+            return (type == GIT_OBJ_TREE) ? 1 : 0;
+        }
+        return git_packbuilder_insert(hydrate->m_packbuilder, git_tree_entry_id(entry), NULL);
+    }
+    // Copies the objects of the checked out commit, which are not yet in the
+    // repository itself, into a pack of its own, so it stays usable without
+    // the archive it borrows its history from
+    void hydrate_head(git_repository* repo)
+    {
+        std::filesystem::path const objects = std::filesystem::path(git_repository_commondir(repo)) / "objects";
+        // an object database without the alternates
+        git_odb *local_odb = NULL;
+        std::unique_ptr<git_odb, decltype(&::git_odb_free)>
+            local_odb_guard(local_odb, &::git_odb_free);
+        check(git_odb_new(&local_odb));
+        local_odb_guard.reset(local_odb);
+        git_odb_backend *backend = NULL;
+        check(git_odb_backend_pack(&backend, objects.string().c_str()));
+        check(git_odb_add_backend(local_odb, backend, 2));
+        check(git_odb_backend_loose(&backend, objects.string().c_str(), -1, 0, 0, 0));
+        check(git_odb_add_backend(local_odb, backend, 1));
+        git_commit *head = NULL;
+        std::unique_ptr<git_commit, decltype(&::git_commit_free)>
+            head_guard(head, &::git_commit_free);
+        check(git_revparse_single(reinterpret_cast<git_object**>(&head), repo, "HEAD^{commit}"));
+        head_guard.reset(head);
+        if (git_odb_exists(local_odb, git_commit_id(head)))
+        {
+            return;
+        }
+        git_tree *tree = NULL;
+        std::unique_ptr<git_tree, decltype(&::git_tree_free)>
+            tree_guard(tree, &::git_tree_free);
+        check(git_commit_tree(&tree, head));
+        tree_guard.reset(tree);
+        git_packbuilder *packbuilder = NULL;
+        std::unique_ptr<git_packbuilder, decltype(&::git_packbuilder_free)>
+            packbuilder_guard(packbuilder, &::git_packbuilder_free);
+        check(git_packbuilder_new(&packbuilder, repo));
+        packbuilder_guard.reset(packbuilder);
+        check(git_packbuilder_insert(packbuilder, git_commit_id(head), NULL));
+        if (!git_odb_exists(local_odb, git_tree_id(tree)))
+        {
+            check(git_packbuilder_insert(packbuilder, git_tree_id(tree), NULL));
+            hydrate_t hydrate = { local_odb, packbuilder };
+            check(git_tree_walk(tree, GIT_TREEWALK_PRE, hydrate_entry, &hydrate));
+        }
+        check(git_packbuilder_write(packbuilder, (objects / "pack").string().c_str(), 0, NULL, NULL));
+    }
+    // Local check whether the submodule has the commit recorded by its
+    // superproject checked out, without modifications
+    static bool is_in_sync(git_submodule *sm, char const *name)
+    {
+        git_oid const* index_id = git_submodule_index_id(sm);
+        git_oid const* wd_id = git_submodule_wd_id(sm);
+        if (!index_id || !wd_id || !git_oid_equal(index_id, wd_id))
+        {
+            return false;
+        }
+        unsigned int status = 0;
+        if (git_submodule_status(&status, git_submodule_owner(sm), name, GIT_SUBMODULE_IGNORE_UNTRACKED) < 0)
         {
-            git_config *cfg = NULL;
-            std::unique_ptr<git_config, decltype(&::git_config_free)>
-                cfg_guard(cfg, &::git_config_free);
-            check(git_config_open_default(&cfg));
-            cfg_guard.reset(cfg);
-            git_config *global_cfg = NULL;
-            std::unique_ptr<git_config, decltype(&::git_config_free)>
-                global_cfg_guard(global_cfg, &::git_config_free);
-            check(git_config_open_level(&global_cfg, cfg, GIT_CONFIG_LEVEL_GLOBAL));
-            global_cfg_guard.reset(global_cfg);
-            check(git_config_set_string(global_cfg, "user.name", repo_ref.m_commit_user));
+            return false;
         }
+        return !(status & (GIT_SUBMODULE_STATUS_WD_UNINITIALIZED | GIT_SUBMODULE_STATUS_WD_INDEX_MODIFIED | GIT_SUBMODULE_STATUS_WD_WD_MODIFIED));
     }
     static int update_submodule(git_submodule *sm, char const *name, void *payload)
     {
-        repo_impl_t* This = static_cast<repo_impl_t*>(payload);
-        This->m_pidentity = This->m_identities.begin();
+        sync_t* sync = static_cast<sync_t*>(payload);
+        if (is_in_sync(sm, name))
+        {
+            sync->m_repo.out() << "Submodule '" << name << "' is up to date" << std::endl;
+            return 0;
+        }
+        sync->m_pidentity = sync->m_identities.begin();
         git_submodule_update_options submodule_update_options = GIT_SUBMODULE_UPDATE_OPTIONS_INIT;
         submodule_update_options.fetch_opts.callbacks.transfer_progress = fetch_progress;
         submodule_update_options.fetch_opts.callbacks.credentials = credentials_cb;
-        submodule_update_options.fetch_opts.callbacks.payload = This;
+        submodule_update_options.fetch_opts.callbacks.payload = sync;
         submodule_update_options.checkout_opts.progress_cb = checkout_progress;
-        submodule_update_options.checkout_opts.progress_payload = This;
-        This->m_fetch_state = fetch_state_t::start_count_objects;
-        This->m_checkout_state = checkout_state_t::start;
-        This->m_os << "Submodule '" << name << "'..." << std::endl;
+        submodule_update_options.checkout_opts.progress_payload = sync;
+        sync->m_fetch_state = fetch_state_t::start_count_objects;
+        sync->m_checkout_state = checkout_state_t::start;
+        sync->m_repo.out() << "Submodule '" << name << "'..." << std::endl;
         return git_submodule_update(sm, true, &submodule_update_options);
     }
-    void check(int error)
+    static void check(int error)
     {
         if (error < 0)
         {
@@ -422,117 +867,108 @@ protected:
             }
         }
     }
-    enum class fetch_state_t
+    // Starts a progress counter
+    void progress_start(sync_t& sync, char const* what)
     {
-        start_count_objects,
-        count_objects,
-        start_count_deltas,
-        count_deltas,
-        ready
-    } m_fetch_state;
+        std::lock_guard<std::mutex> lock(m_os_mutex);
+        sync.m_reported_percent = 0;
+        if (!m_line_progress)
+        {
+            m_os << what << " : 0\b";
+            m_os.flush();
+        }
+    }
+    // Updates a progress counter, in place, or when several get() calls run
+    // concurrently, as a line for every tenth part; returns true when done
+    bool progress(sync_t& sync, char const* what, size_t cur, size_t tot)
+    {
+        std::lock_guard<std::mutex> lock(m_os_mutex);
+        if (m_line_progress)
+        {
+            size_t const percent = tot ? (cur * 100 / tot) : 100;
+            if ((cur == tot) || (percent >= sync.m_reported_percent + 10))
+            {
+                sync.m_reported_percent = percent;
+                m_os << '\'' << sync.m_name << "' " << what << " : " << cur << '/' << tot;
+                m_os << ((cur == tot) ? ", done." : "") << std::endl;
+            }
+            return cur == tot;
+        }
+        size_t current = cur;
+        m_os << current;
+        while (current)
+        {
+            m_os << '\b';
+            current /= 10;
+        }
+        if (cur == tot)
+        {
+            m_os << tot << ", done." << std::endl;
+            return true;
+        }
+        m_os.flush();
+        return false;
+    }
     static int fetch_progress(
         git_transfer_progress const * stats,
         void *payload)
     {
-        repo_impl_t* This = static_cast<repo_impl_t*>(payload);
-        switch (This->m_fetch_state)
+        sync_t* sync = static_cast<sync_t*>(payload);
+        repo_impl_t* This = &sync->m_repo;
+        switch (sync->m_fetch_state)
         {
         case fetch_state_t::start_count_objects:
         {
-            This->m_os << "counting objects : 0\b";
-            This->m_os.flush();
-            This->m_fetch_state = fetch_state_t::count_objects;
+            This->progress_start(*sync, "counting objects");
+            sync->m_fetch_state = fetch_state_t::count_objects;
             break;
         }
         case fetch_state_t::count_objects:
         {
-            unsigned int received_objects = stats->received_objects;
-            This->m_os << received_objects;
-            while (received_objects)
-            {
-                This->m_os << '\b';
-                received_objects /= 10;
-            }
-            if (stats->received_objects == stats->total_objects)
-            {
-                This->m_os << stats->total_objects << ", done." << std::endl;
-                This->m_fetch_state = fetch_state_t::start_count_deltas;
-            }
-            else
+            if (This->progress(*sync, "counting objects", stats->received_objects, stats->total_objects))
             {
-                This->m_os.flush();
+                sync->m_fetch_state = fetch_state_t::start_count_deltas;
             }
             break;
         }
         case fetch_state_t::start_count_deltas:
         {
-            This->m_os << "counting deltas : 0\b";
-            This->m_os.flush();
-            This->m_fetch_state = fetch_state_t::count_deltas;
+            This->progress_start(*sync, "counting deltas");
+            sync->m_fetch_state = fetch_state_t::count_deltas;
             break;
         }
         case fetch_state_t::count_deltas:
         {
-            unsigned int indexed_deltas = stats->indexed_deltas;
-            This->m_os << indexed_deltas;
-            while (indexed_deltas)
-            {
-                This->m_os << '\b';
-                indexed_deltas /= 10;
-            }
-            if (stats->indexed_deltas == stats->total_deltas)
-            {
-                This->m_os << stats->total_deltas << ", done." << std::endl;
-                This->m_fetch_state = fetch_state_t::ready;
-            }
-            else
+            if (This->progress(*sync, "counting deltas", stats->indexed_deltas, stats->total_deltas))
             {
-                This->m_os.flush();
+                sync->m_fetch_state = fetch_state_t::ready;
             }
             break;
         }
         }
         return 0;
     }
-    enum class checkout_state_t
-    {
-        start,
-        count,
-        ready
-    } m_checkout_state;
     static void checkout_progress(
         const char *path,
         size_t cur,
         size_t tot,
         void *payload)
     {
-        repo_impl_t* This = static_cast<repo_impl_t*>(payload);
-        switch (This->m_checkout_state)
+        sync_t* sync = static_cast<sync_t*>(payload);
+        repo_impl_t* This = &sync->m_repo;
+        switch (sync->m_checkout_state)
         {
         case checkout_state_t::start:
         {
-            This->m_os << "checking out : 0\b";
-            This->m_os.flush();
-            This->m_checkout_state = checkout_state_t::count;
+            This->progress_start(*sync, "checking out");
+            sync->m_checkout_state = checkout_state_t::count;
             break;
         }
         case checkout_state_t::count:
         {
-            size_t current = cur;
-            This->m_os << current;
-            while (current)
-            {
-                This->m_os << '\b';
-                current /= 10;
-            }
-            if (cur == tot)
-            {
-                This->m_os << tot << ", done." << std::endl;
-                This->m_checkout_state = checkout_state_t::ready;
-            }
-            else
+            if (This->progress(*sync, "checking out", cur, tot))
             {
-                This->m_os.flush();
+                sync->m_checkout_state = checkout_state_t::ready;
             }
         }
         }
@@ -540,31 +976,32 @@ protected:
     static int credentials_cb(git_cred **out, const char *url, const char *username_from_url,
         unsigned int allowed_types, void *payload)
     {
-        repo_impl_t* This = static_cast<repo_impl_t*>(payload);
+        sync_t* sync = static_cast<sync_t*>(payload);
+        repo_impl_t* This = &sync->m_repo;
         std::string user;
         std::string pass;
          
-        if ((allowed_types & GIT_CREDTYPE_SSH_KEY /* = (1u << 1)*/) && (This->m_pidentity != This->m_identities.end()))
+        if ((allowed_types & GIT_CREDTYPE_SSH_KEY /* = (1u << 1)*/) && (sync->m_pidentity != sync->m_identities.end()))
         {
-            identities_t::const_iterator pidentity = This->m_pidentity++;
+            identities_t::const_iterator pidentity = sync->m_pidentity++;
 
-            This->m_os << "Authentication with " << pidentity->m_publ << std::endl;
+            This->out() << "Authentication with " << pidentity->m_publ << std::endl;
             return git_cred_ssh_key_new(out,
-                /* user name */   This->m_user,
+                /* user name */   sync->m_user,
                 /* public key */  pidentity->m_publ.string().c_str(),
                 /* private key */ pidentity->m_priv.string().c_str(),
                 /* passphrase */  "");
         }
         else if (allowed_types & GIT_CREDTYPE_USERPASS_PLAINTEXT /* = (1u << 0)*/)
         {
-            This->m_os << "Authentication: user password" << std::endl;
+            This->out() << "Authentication: user password" << std::endl;
             if (int error = This->ask_user(user, pass, url, username_from_url, allowed_types)) { return error; }
             return git_cred_userpass_plaintext_new(out, user.c_str(), pass.c_str());
         }
         else if (allowed_types & GIT_CREDTYPE_USERNAME /* = (1u << 5)*/)
         {
-            This->m_os << "Authentication: username for SSH" << std::endl;
-            return git_cred_username_new(out, This->m_user);
+            This->out() << "Authentication: username for SSH" << std::endl;
+            return git_cred_username_new(out, sync->m_user);
         }
         else
         {
@@ -590,6 +1027,7 @@ protected:
     {
         try
         {
+            std::lock_guard<std::mutex> lock(m_os_mutex);
             m_ask_pwd_user(m_os, m_is, user, pass, url);
         }
         catch (...)
@@ -601,9 +1039,17 @@ protected:
     std::ostream& m_os;
     std::istream& m_is;
     repo::ask_user_pwd_t m_ask_pwd_user;
-    identities_t m_identities;
-    identities_t::const_iterator m_pidentity;
-    char const* m_user;
+    bool m_line_progress;
+    bool m_partial_clone;
+    bool m_worktrees;
+    unsigned m_archive_readers;
+    unsigned m_index_threads;
+    size_t m_index_cache_size;
+    repo::device_readers_t m_device_readers;
+    std::mutex m_os_mutex;
+    std::mutex m_config_mutex;
+    std::mutex m_identities_mutex;
+    std::map<std::string, identities_t> m_identities;
 };
 
 }; // namespace anonymous
@@ -616,4 +1062,9 @@ std::unique_ptr<repo_t> create_repo(std::ostream& os, std::istream& is, ask_user
     return std::make_unique<repo_impl_t>(os, is, ask_pwd_user);
 }
 
+void set_sync_options(repo_t& repo, sync_options_t const& options)
+{
+    dynamic_cast<repo_impl_t&>(repo).set_options(options);
+}
+
 }; // namespace repo
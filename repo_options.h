@@ -0,0 +1,39 @@
+#ifndef REPO_OPTIONS
+#define REPO_OPTIONS
+
+#include "repo/repo.h"
+
+namespace repo
+{
+
+// Settings of a repo_t created by create_repo(), beyond those of repo/repo.h
+struct sync_options_t
+{
+    // report progress as whole lines, so that concurrent get() calls do
+    // not overwrite each other's counters
+    bool m_line_progress = false;
+    // clone local archives without copying their objects, borrowing them
+    // instead, and keep only the objects of the checked out commit locally
+    bool m_partial_clone = false;
+    // get() into a 'dirname' other than the local name of the repository
+    // attaches a working tree to the clone at the local name, when it
+    // exists, so that both share one object database; fetches then update
+    // the branches of all working trees
+    bool m_worktrees = false;
+    // at most this many get() calls read from the same slow device, e.g. a
+    // USB stick, at once, and clones read the packs of such archives ahead
+    // sequentially; 0 leaves local archives untuned
+    unsigned m_archive_readers = 0;
+    // resolve the deltas of fetched packs on this many threads, keeping up
+    // to m_index_cache_size bytes of resolved bases per pack; 0 leaves the
+    // packs to the indexer of libgit2, which resolves them on one thread.
+    // Submodules are always left to it, as libgit2 fetches them itself.
+    unsigned m_index_threads = 0;
+    size_t m_index_cache_size = 0;
+};
+
+void set_sync_options(repo_t& repo, sync_options_t const& options);
+
+}; // namespace repo
+
+#endif // REPO_OPTIONS
@@ -0,0 +1,121 @@
+#include "sha1.h"
+#include <algorithm>
+#include <cstring>
+
+namespace // anonymous
+{
+
+inline uint32_t rol(uint32_t value, unsigned bits)
+{
+    return (value << bits) | (value >> (32 - bits));
+}
+
+}; // anonymous
+
+namespace repo
+{
+
+sha1_t::sha1_t()
+    : m_state{ 0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476, 0xC3D2E1F0 }
+    , m_size(0)
+{
+}
+
+void sha1_t::update(void const* data, size_t size)
+{
+    uint8_t const* bytes = static_cast<uint8_t const*>(data);
+    size_t used = m_size % sizeof(m_block);
+    m_size += size;
+    if (used)
+    {
+        size_t const part = std::min(size, sizeof(m_block) - used);
+        std::memcpy(m_block + used, bytes, part);
+        bytes += part;
+        size -= part;
+        if (used + part < sizeof(m_block))
+        {
+            return;
+        }
+        transform(m_block);
+    }
+    for (; size >= sizeof(m_block); bytes += sizeof(m_block), size -= sizeof(m_block))
+    {
+        transform(bytes);
+    }
+    std::memcpy(m_block, bytes, size);
+}
+
+sha1_digest_t sha1_t::digest()
+{
+    uint64_t const bits = m_size * 8;
+    uint8_t padding[sizeof(m_block) + 8] = { 0x80 };
+    size_t const used = m_size % sizeof(m_block);
+    size_t const padding_size = ((used < 56) ? 56 : 120) - used;
+    for (unsigned i = 0; i < 8; ++i)
+    {
+        padding[padding_size + i] = static_cast<uint8_t>(bits >> (56 - 8 * i));
+    }
+    update(padding, padding_size + 8);
+    sha1_digest_t digest;
+    for (unsigned i = 0; i < 20; ++i)
+    {
+        digest[i] = static_cast<uint8_t>(m_state[i / 4] >> (24 - 8 * (i % 4)));
+    }
+    return digest;
+}
+
+void sha1_t::transform(uint8_t const* block)
+{
+    uint32_t w[80];
+    for (unsigned i = 0; i < 16; ++i)
+    {
+        w[i] = (uint32_t(block[4 * i]) << 24) | (uint32_t(block[4 * i + 1]) << 16) | (uint32_t(block[4 * i + 2]) << 8) | block[4 * i + 3];
+    }
+    for (unsigned i = 16; i < 80; ++i)
+    {
+        w[i] = rol(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+    }
+    uint32_t a = m_state[0];
+    uint32_t b = m_state[1];
+    uint32_t c = m_state[2];
+    uint32_t d = m_state[3];
+    uint32_t e = m_state[4];
+    for (unsigned i = 0; i < 80; ++i)
+    {
+        uint32_t f;
+        uint32_t k;
+        if (i < 20)
+        {
+            f = (b & c) | (~b & d);
+            k = 0x5A827999;
+        }
+        else if (i < 40)
+        {
+            f = b ^ c ^ d;
+            k = 0x6ED9EBA1;
+        }
+        else if (i < 60)
+        {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8F1BBCDC;
+        }
+        else
+        {
+            f = b ^ c ^ d;
+            k = 0xCA62C1D6;
+        }
+        uint32_t const temp = rol(a, 5) + f + e + k + w[i];
+        e = d;
+        d = c;
+        c = rol(b, 30);
+        b = a;
+        a = temp;
+    }
+    m_state[0] += a;
+    m_state[1] += b;
+    m_state[2] += c;
+    m_state[3] += d;
+    m_state[4] += e;
+}
+
+}; // namespace repo
@@ -0,0 +1,30 @@
+#ifndef REPO_SHA1
+#define REPO_SHA1
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace repo
+{
+
+typedef std::array<uint8_t, 20> sha1_digest_t;
+
+// Computes the SHA-1 of data which is passed in pieces, as git names its
+// objects and checksums its packs
+class sha1_t
+{
+public:
+    sha1_t();
+    void update(void const* data, size_t size);
+    sha1_digest_t digest();
+private:
+    void transform(uint8_t const* block);
+    uint32_t m_state[5];
+    uint64_t m_size;
+    uint8_t m_block[64];
+};
+
+}; // namespace repo
+
+#endif // REPO_SHA1
@@ -0,0 +1,224 @@
+#include "status.h"
+#include "build_output.h"
+#include <algorithm>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include "git_util.h"
+
+namespace // anonymous
+{
+
+using repo::check;
+using repo::to_string;
+
+struct submodules_t
+{
+    std::filesystem::path m_repo_path;
+    std::vector<repo::status_t::submodule_t>* m_submodules;
+};
+
+int add_submodule(git_submodule *sm, char const *name, void *payload)
+{
+    submodules_t* submodules = static_cast<submodules_t*>(payload);
+    git_oid const* index_id = git_submodule_index_id(sm);
+    submodules->m_submodules->push_back(repo::status_t::submodule_t{
+        submodules->m_repo_path / git_submodule_path(sm),
+        index_id ? to_string(*index_id) : std::string() });
+    return 0;
+}
+
+// The branch which HEAD of the remote pointed to when it was cloned, which
+// a sync without a branch checks out
+std::string get_default_branch(git_repository* repo)
+{
+    git_reference *remote_head = NULL;
+    if (git_reference_lookup(&remote_head, repo, "refs/remotes/origin/HEAD") < 0)
+    {
+        return "master";
+    }
+    std::unique_ptr<git_reference, decltype(&::git_reference_free)>
+        remote_head_guard(remote_head, &::git_reference_free);
+    std::string const prefix("refs/remotes/origin/");
+    char const* target = git_reference_symbolic_target(remote_head);
+    std::string const branch(target ? target : "");
+    return (branch.compare(0, prefix.size(), prefix) == 0) ? branch.substr(prefix.size()) : std::string("master");
+}
+
+void read_status(repo::status_t& status, char const* branch, char const* commit_sha)
+{
+    git_repository *repo = NULL;
+    std::unique_ptr<git_repository, decltype(&::git_repository_free)>
+        repo_guard(repo, &::git_repository_free);
+    check(git_repository_open(&repo, status.m_path.string().c_str()));
+    repo_guard.reset(repo);
+    git_reference *head = NULL;
+    std::unique_ptr<git_reference, decltype(&::git_reference_free)>
+        head_guard(head, &::git_reference_free);
+    check(git_repository_head(&head, repo));
+    head_guard.reset(head);
+    bool const detached = git_repository_head_detached(repo) == 1;
+    git_oid const head_id = *git_reference_target(head);
+    status.m_detached = detached;
+    if (detached)
+    {
+        status.m_head = to_string(head_id);
+    }
+    else
+    {
+        char const* head_branch = NULL;
+        check(git_branch_name(&head_branch, head));
+        status.m_head = head_branch;
+    }
+    if (commit_sha)
+    {
+        status.m_expected = commit_sha;
+        status.m_on_expected = status.m_expected == to_string(head_id);
+    }
+    else
+    {
+        status.m_expected = branch ? branch : get_default_branch(repo);
+        status.m_on_expected = !detached && (status.m_head == status.m_expected);
+    }
+    if (!detached)
+    {
+        git_reference *upstream = NULL;
+        std::unique_ptr<git_reference, decltype(&::git_reference_free)>
+            upstream_guard(upstream, &::git_reference_free);
+        int error = git_branch_upstream(&upstream, head);
+        if (error != GIT_ENOTFOUND)
+        {
+            check(error);
+            upstream_guard.reset(upstream);
+            check(git_graph_ahead_behind(&status.m_unpushed_commits, &status.m_behind_commits,
+                repo, &head_id, git_reference_target(upstream)));
+        }
+    }
+    git_status_options status_options = GIT_STATUS_OPTIONS_INIT;
+    status_options.show = GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
+    status_options.flags = GIT_STATUS_OPT_INCLUDE_UNTRACKED | GIT_STATUS_OPT_EXCLUDE_SUBMODULES;
+    git_status_list *status_list = NULL;
+    std::unique_ptr<git_status_list, decltype(&::git_status_list_free)>
+        status_list_guard(status_list, &::git_status_list_free);
+    check(git_status_list_new(&status_list, repo, &status_options));
+    status_list_guard.reset(status_list);
+    // built repositories are not dirty
+    for (size_t i = 0; i < git_status_list_entrycount(status_list); ++i)
+    {
+        git_status_entry const* entry = git_status_byindex(status_list, i);
+        git_diff_delta const* delta = entry->index_to_workdir ? entry->index_to_workdir : entry->head_to_index;
+        if (!delta || !repo::is_build_output(delta->old_file.path))
+        {
+            ++status.m_dirty_files;
+        }
+    }
+    submodules_t submodules = { status.m_path, &status.m_submodules };
+    check(git_submodule_foreach(repo, add_submodule, &submodules));
+}
+
+std::string json_string(std::string const& s)
+{
+    std::stringstream ss;
+    ss << '"';
+    for (char c : s)
+    {
+        if ((c == '"') || (c == '\\'))
+        {
+            ss << '\\' << c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            ss << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec;
+        }
+        else
+        {
+            ss << c;
+        }
+    }
+    ss << '"';
+    return ss.str();
+}
+
+}; // anonymous
+
+namespace repo
+{
+
+status_t get_status(std::filesystem::path const& repo_path, char const* branch, char const* commit_sha)
+{
+    status_t status;
+    status.m_path = repo_path;
+    try
+    {
+        if (!std::filesystem::exists(repo_path))
+        {
+            throw std::runtime_error("not cloned");
+        }
+        read_status(status, branch, commit_sha);
+    }
+    catch (std::exception const& e)
+    {
+        status.m_error = e.what();
+    }
+    return status;
+}
+
+void print_status_table(std::ostream& os, std::vector<status_t> const& statuses)
+{
+    // commits are abbreviated, branches are not
+    size_t const commit_width = 12;
+    size_t width = 10;
+    size_t head_width = commit_width;
+    for (status_t const& status : statuses)
+    {
+        width = std::max(width, status.m_path.string().size());
+        if (!status.m_detached)
+        {
+            head_width = std::max(head_width, status.m_head.size());
+        }
+    }
+    os << std::left << std::setw(width) << "repository" << "  " << std::setw(head_width) << "head" << "  "
+        << std::right << std::setw(6) << "dirty" << "  " << std::setw(8) << "unpushed" << "  "
+        << std::setw(6) << "behind" << "  " << std::left << "note" << std::endl;
+    for (status_t const& status : statuses)
+    {
+        os << std::left << std::setw(width) << status.m_path.string() << "  " << std::setw(head_width)
+            << (status.m_detached ? status.m_head.substr(0, commit_width) : status.m_head) << "  " << std::right << std::setw(6) << status.m_dirty_files << "  "
+            << std::setw(8) << status.m_unpushed_commits << "  " << std::setw(6) << status.m_behind_commits << "  "
+            << std::left;
+        if (!status.m_error.empty())
+        {
+            os << status.m_error;
+        }
+        else if (!status.m_on_expected)
+        {
+            os << "expected " << status.m_expected;
+        }
+        os << std::endl;
+    }
+}
+
+void print_status_json(std::ostream& os, std::vector<status_t> const& statuses)
+{
+    os << '[';
+    for (size_t i = 0; i < statuses.size(); ++i)
+    {
+        status_t const& status = statuses[i];
+        os << (i ? ",\n " : "\n ") << "{\"path\": " << json_string(status.m_path.generic_string());
+        if (!status.m_error.empty())
+        {
+            os << ", \"error\": " << json_string(status.m_error) << '}';
+            continue;
+        }
+        os << ", \"head\": " << json_string(status.m_head)
+            << ", \"expected\": " << json_string(status.m_expected)
+            << ", \"on_expected\": " << (status.m_on_expected ? "true" : "false")
+            << ", \"dirty_files\": " << status.m_dirty_files
+            << ", \"unpushed_commits\": " << status.m_unpushed_commits
+            << ", \"behind_commits\": " << status.m_behind_commits << '}';
+    }
+    os << "\n]" << std::endl;
+}
+
+}; // namespace repo
@@ -0,0 +1,47 @@
+#ifndef REPO_STATUS
+#define REPO_STATUS
+
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace repo
+{
+
+struct status_t
+{
+    std::filesystem::path m_path;
+    // the checked out branch, or the commit when HEAD is detached
+    std::string m_head;
+    bool m_detached = false;
+    // the branch, or commit, which a sync would check out
+    std::string m_expected;
+    bool m_on_expected = false;
+    size_t m_dirty_files = 0;
+    // commits of the branch which its upstream does not have, and vice versa
+    size_t m_unpushed_commits = 0;
+    size_t m_behind_commits = 0;
+    std::string m_error;
+    struct submodule_t
+    {
+        std::filesystem::path m_path;
+        std::string m_commit;
+    };
+    std::vector<submodule_t> m_submodules;
+};
+
+// Reads the status of the repository in 'repo_path' from local data only,
+// i.e. without contacting its remote. Compares HEAD with 'commit_sha' when
+// given, and else with 'branch', where no branch means the default branch
+// of the remote as last fetched, or master when that is unknown.
+// Lists the submodules with the commits recorded for them, but does not
+// read their status. Never throws; failures are reported in m_error.
+status_t get_status(std::filesystem::path const& repo_path, char const* branch, char const* commit_sha);
+
+void print_status_table(std::ostream& os, std::vector<status_t> const& statuses);
+void print_status_json(std::ostream& os, std::vector<status_t> const& statuses);
+
+}; // namespace repo
+
+#endif // REPO_STATUS
@@ -0,0 +1,132 @@
+#include "sync_history.h"
+#include <algorithm>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+
+namespace repo
+{
+
+sync_history_t::sync_history_t(std::filesystem::path const& file)
+    : m_file(file)
+{
+    // one line per repository: duration in ms, size in bytes, local name
+    std::ifstream is(m_file);
+    std::string line;
+    while (std::getline(is, line))
+    {
+        std::istringstream fields(line);
+        long long duration = 0;
+        entry_t entry;
+        std::string local;
+        if ((fields >> duration >> entry.m_size) && (fields.get() == '\t') && std::getline(fields, local) && !local.empty())
+        {
+            entry.m_duration = std::chrono::milliseconds(duration);
+            m_entries[local] = entry;
+        }
+    }
+}
+
+void sync_history_t::record(std::string const& local, entry_t const& entry)
+{
+    m_entries[local] = entry;
+}
+
+void sync_history_t::save() const
+{
+    std::filesystem::create_directories(m_file.parent_path());
+    // concurrent runs each write a file of their own
+    std::filesystem::path temp(m_file);
+    temp += ".tmp." + std::to_string(std::random_device()());
+    {
+        std::ofstream os(temp, std::ios::trunc);
+        for (auto const& entry : m_entries)
+        {
+            os << entry.second.m_duration.count() << '\t' << entry.second.m_size << '\t' << entry.first << '\n';
+        }
+        if (!os.flush())
+        {
+            os.close();
+            std::filesystem::remove(temp);
+            throw std::runtime_error("Cannot write '" + temp.string() + "'");
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temp, m_file, error);
+    if (error)
+    {
+        std::error_code ignored;
+        std::filesystem::remove(temp, ignored);
+        throw std::filesystem::filesystem_error("Cannot replace the sync history", temp, m_file, error);
+    }
+}
+
+std::vector<size_t> sync_history_t::order(std::vector<repository_t> const& repositories, std::filesystem::path const& path) const
+{
+    // the throughput of earlier syncs estimates those without history
+    double known_duration = 0;
+    double known_size = 0;
+    size_t known = 0;
+    for (repository_t const& repository : repositories)
+    {
+        auto pentry = m_entries.find(repository.m_local);
+        if (pentry != m_entries.end())
+        {
+            known_duration += double(pentry->second.m_duration.count());
+            known_size += double(pentry->second.m_size);
+            ++known;
+        }
+    }
+    double const average = known ? (known_duration / known) : 1;
+    std::vector<double> priorities(repositories.size());
+    for (size_t i = 0; i < repositories.size(); ++i)
+    {
+        double duration = average;
+        auto pentry = m_entries.find(repositories[i].m_local);
+        if (pentry != m_entries.end())
+        {
+            duration = double(pentry->second.m_duration.count());
+        }
+        else if (known_size > 0)
+        {
+            uint64_t const size = get_object_size(path / repositories[i].m_local);
+            if (size)
+            {
+                duration = double(size) * known_duration / known_size;
+            }
+        }
+        // its own build and all which follow wait on it
+        priorities[i] = duration * double(repositories.size() - i);
+    }
+    std::vector<size_t> indexes(repositories.size());
+    for (size_t i = 0; i < indexes.size(); ++i)
+    {
+        indexes[i] = i;
+    }
+    // ties, e.g. on the first run, keep the listed order
+    std::stable_sort(indexes.begin(), indexes.end(), [&](size_t lhs, size_t rhs)
+    {
+        return priorities[lhs] > priorities[rhs];
+    });
+    return indexes;
+}
+
+uint64_t get_object_size(std::filesystem::path const& repo_path)
+{
+    std::filesystem::path const objects = repo_path / ".git" / "objects";
+    std::error_code error;
+    uint64_t size = 0;
+    for (std::filesystem::recursive_directory_iterator pentry(objects, error), end; !error && (pentry != end); pentry.increment(error))
+    {
+        std::error_code file_error;
+        uintmax_t const file_size = pentry->is_regular_file(file_error) ? pentry->file_size(file_error) : 0;
+        if (!file_error)
+        {
+            size += file_size;
+        }
+    }
+    return size;
+}
+
+}; // namespace repo
@@ -0,0 +1,50 @@
+#ifndef REPO_SYNC_HISTORY
+#define REPO_SYNC_HISTORY
+
+#include "repo/repo.h"
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace repo
+{
+
+// The duration of the last sync of each repository and the size of its
+// object database, kept in a file between runs to schedule the next syncs
+class sync_history_t
+{
+public:
+    struct entry_t
+    {
+        std::chrono::milliseconds m_duration = std::chrono::milliseconds::zero();
+        uint64_t m_size = 0;
+    };
+    // Reads 'file' when it exists
+    explicit sync_history_t(std::filesystem::path const& file);
+    void record(std::string const& local, entry_t const& entry);
+    // Replaces the file, so that concurrent runs never read a partial one
+    void save() const;
+    // Returns the indexes of 'repositories' in the order in which to start
+    // their syncs. The builds run in the order of 'repositories', where each
+    // may depend on all listed before it and starts once these and its own
+    // repository have synced, so a repository holds up its own build and
+    // all which follow. The syncs which take longest times the
+    // number of builds waiting on them start first. Repositories without
+    // history are estimated from the size of their object database, or
+    // else from the average of the others.
+    std::vector<size_t> order(std::vector<repository_t> const& repositories, std::filesystem::path const& path) const;
+private:
+    std::filesystem::path m_file;
+    std::map<std::string, entry_t> m_entries;
+};
+
+// The size of the files of the object database of the repository in
+// 'repo_path', or 0 when it is not cloned
+uint64_t get_object_size(std::filesystem::path const& repo_path);
+
+}; // namespace repo
+
+#endif // REPO_SYNC_HISTORY
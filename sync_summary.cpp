@@ -0,0 +1,92 @@
+#include "sync_summary.h"
+#include "platform_specific.h"
+#include <algorithm>
+#include <iomanip>
+
+namespace repo
+{
+
+sync_summary_t::sync_summary_t(size_t repositories)
+    : m_stop(false)
+    , m_entries(repositories)
+    , m_sampler(&sync_summary_t::sample, this)
+{
+}
+
+sync_summary_t::~sync_summary_t()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_stopping.notify_one();
+    m_sampler.join();
+}
+
+void sync_summary_t::start(size_t index)
+{
+    size_t const resident = get_resident_memory();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    entry_t& entry = m_entries[index];
+    entry.m_active = true;
+    entry.m_start = std::chrono::steady_clock::now();
+    entry.m_peak_resident = resident;
+}
+
+void sync_summary_t::stop(size_t index)
+{
+    size_t const resident = get_resident_memory();
+    std::lock_guard<std::mutex> lock(m_mutex);
+    entry_t& entry = m_entries[index];
+    entry.m_active = false;
+    entry.m_duration = std::chrono::steady_clock::now() - entry.m_start;
+    entry.m_peak_resident = std::max(entry.m_peak_resident, resident);
+}
+
+std::vector<sync_summary_t::entry_t> sync_summary_t::entries() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries;
+}
+
+void sync_summary_t::print(std::ostream& os, std::vector<repository_t> const& repositories) const
+{
+    std::vector<entry_t> const entries = this->entries();
+    std::ios_base::fmtflags const flags = os.flags();
+    std::streamsize const precision = os.precision();
+    size_t width = 10;
+    for (repository_t const& repository : repositories)
+    {
+        width = std::max(width, std::string(repository.m_local).size());
+    }
+    os << std::left << std::setw(width) << "repository" << "  " << std::right << std::setw(10) << "time [s]"
+        << "  " << std::setw(14) << "peak RSS [MiB]" << std::endl;
+    for (size_t i = 0; (i < entries.size()) && (i < repositories.size()); ++i)
+    {
+        os << std::left << std::setw(width) << repositories[i].m_local << "  " << std::right << std::fixed
+            << std::setprecision(1) << std::setw(10) << std::chrono::duration<double>(entries[i].m_duration).count()
+            << "  " << std::setw(14) << (entries[i].m_peak_resident >> 20) << std::endl;
+    }
+    os.flags(flags);
+    os.precision(precision);
+}
+
+void sync_summary_t::sample()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (!m_stopping.wait_for(lock, std::chrono::milliseconds(100), [this] { return m_stop; }))
+    {
+        lock.unlock();
+        size_t const resident = get_resident_memory();
+        lock.lock();
+        for (entry_t& entry : m_entries)
+        {
+            if (entry.m_active)
+            {
+                entry.m_peak_resident = std::max(entry.m_peak_resident, resident);
+            }
+        }
+    }
+}
+
+}; // namespace repo
@@ -0,0 +1,45 @@
+#ifndef REPO_SYNC_SUMMARY
+#define REPO_SYNC_SUMMARY
+
+#include "repo/repo.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <ostream>
+#include <thread>
+#include <vector>
+
+namespace repo
+{
+
+// Records how long the sync of each repository takes and the peak resident
+// memory of the process while it runs. Syncs may run concurrently, so the
+// memory of a repository includes that of the syncs which overlap with it.
+class sync_summary_t
+{
+public:
+    struct entry_t
+    {
+        bool m_active = false;
+        std::chrono::steady_clock::time_point m_start;
+        std::chrono::steady_clock::duration m_duration = std::chrono::steady_clock::duration::zero();
+        size_t m_peak_resident = 0;
+    };
+    explicit sync_summary_t(size_t repositories);
+    ~sync_summary_t();
+    void start(size_t index);
+    void stop(size_t index);
+    std::vector<entry_t> entries() const;
+    void print(std::ostream& os, std::vector<repository_t> const& repositories) const;
+private:
+    void sample();
+    mutable std::mutex m_mutex;
+    std::condition_variable m_stopping;
+    bool m_stop;
+    std::vector<entry_t> m_entries;
+    std::thread m_sampler;
+};
+
+}; // namespace repo
+
+#endif // REPO_SYNC_SUMMARY
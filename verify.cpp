@@ -0,0 +1,337 @@
+#include "verify.h"
+#include "parallel.h"
+#include "platform_specific.h"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include "git_util.h"
+
+namespace // anonymous
+{
+
+// files up to this size are read into a buffer, larger ones are mapped
+size_t const max_read_size = 1 << 20;
+
+using repo::check;
+
+struct entry_t
+{
+    std::string m_path;
+    git_oid m_id;
+    uint32_t m_file_size;
+    git_index_time m_mtime;
+};
+
+enum class outcome_t : char
+{
+    match,
+    modified,
+    corrupt,
+    damaged_object,
+    failed
+};
+
+// True when the file still has the size and modification time which the
+// index recorded when it was checked out, i.e. when it was not written since
+bool is_unchanged(std::filesystem::path const& file, entry_t const& entry)
+{
+    repo::file_stat_t stat;
+    if (!repo::get_file_stat(file, stat))
+    {
+        return false;
+    }
+    // the index keeps the lower 32 bits of the size, and no nanoseconds
+    // when libgit2 is built without them
+    return (static_cast<uint32_t>(stat.m_size) == entry.m_file_size) &&
+        (stat.m_mtime_seconds == entry.m_mtime.seconds) &&
+        ((entry.m_mtime.nanoseconds == 0) || (stat.m_mtime_nanoseconds == entry.m_mtime.nanoseconds));
+}
+
+// Hashes the file as a blob the way it would be added to the index, i.e.
+// after the filters which apply to it, like line ending conversion
+git_oid hash(git_repository* repo, std::filesystem::path const& workdir, entry_t const& entry, std::vector<char>& buffer)
+{
+    std::filesystem::path const file = workdir / entry.m_path;
+    git_oid id;
+    if (std::filesystem::is_symlink(file))
+    {
+        std::string const target = std::filesystem::read_symlink(file).generic_string();
+        check(git_odb_hash(&id, target.data(), target.size(), GIT_OBJ_BLOB));
+        return id;
+    }
+    git_filter_list *filters = NULL;
+    check(git_filter_list_load(&filters, repo, NULL, entry.m_path.c_str(), GIT_FILTER_TO_ODB, GIT_FILTER_DEFAULT));
+    if (filters)
+    {
+        git_filter_list_free(filters);
+        check(git_repository_hashfile(&id, repo, entry.m_path.c_str(), GIT_OBJ_BLOB, NULL));
+        return id;
+    }
+    size_t const size = static_cast<size_t>(std::filesystem::file_size(file));
+    if (size <= max_read_size)
+    {
+        buffer.resize(size);
+        std::ifstream is(file, std::ios::binary);
+        if (!is.read(buffer.data(), size))
+        {
+            throw std::runtime_error("Cannot read '" + file.string() + "'");
+        }
+        check(git_odb_hash(&id, buffer.data(), size, GIT_OBJ_BLOB));
+    }
+    else
+    {
+        repo::mapped_file_t const mapped(file);
+        check(git_odb_hash(&id, mapped.data(), mapped.size(), GIT_OBJ_BLOB));
+    }
+    return id;
+}
+
+void verify_repository(repo::verify_result_t& result, unsigned jobs, repo::repair_t repair)
+{
+    git_repository *repo = NULL;
+    std::unique_ptr<git_repository, decltype(&::git_repository_free)>
+        repo_guard(repo, &::git_repository_free);
+    check(git_repository_open(&repo, result.m_path.string().c_str()));
+    repo_guard.reset(repo);
+    if (git_repository_is_bare(repo))
+    {
+        throw std::runtime_error("no working tree");
+    }
+    std::vector<entry_t> entries;
+    {
+        git_index *index = NULL;
+        std::unique_ptr<git_index, decltype(&::git_index_free)>
+            index_guard(index, &::git_index_free);
+        check(git_repository_index(&index, repo));
+        index_guard.reset(index);
+        size_t const count = git_index_entrycount(index);
+        entries.reserve(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            git_index_entry const* entry = git_index_get_byindex(index, i);
+            // submodules, conflicts and files outside a sparse checkout have
+            // nothing to compare with
+            if ((entry->mode == GIT_FILEMODE_COMMIT) || (git_index_entry_stage(entry) != 0) ||
+                (entry->flags_extended & GIT_IDXENTRY_SKIP_WORKTREE))
+            {
+                continue;
+            }
+            entries.push_back(entry_t{ entry->path, entry->id, entry->file_size, entry->mtime });
+        }
+    }
+    result.m_files = entries.size();
+    // reading an object back checks its content against its ID
+    check(git_libgit2_opts(GIT_OPT_ENABLE_STRICT_HASH_VERIFICATION, 1));
+    std::filesystem::path const workdir(git_repository_workdir(repo));
+    std::string const gitdir(git_repository_path(repo));
+    // libgit2 objects must not be shared between threads, so each thread
+    // opens the repository itself and takes the next entry when done
+    std::vector<outcome_t> outcomes(entries.size(), outcome_t::match);
+    std::vector<std::string> failures(entries.size());
+    std::atomic<size_t> next(0);
+    std::vector<unsigned> workers(std::max(std::min<size_t>(jobs, entries.size()), size_t(1)));
+    repo::parallel_for_each(workers.begin(), workers.end(), unsigned(workers.size()), [&](unsigned)
+    {
+        git_repository *worker_repo = NULL;
+        std::unique_ptr<git_repository, decltype(&::git_repository_free)>
+            worker_repo_guard(worker_repo, &::git_repository_free);
+        check(git_repository_open(&worker_repo, gitdir.c_str()));
+        worker_repo_guard.reset(worker_repo);
+        git_odb *odb = NULL;
+        std::unique_ptr<git_odb, decltype(&::git_odb_free)>
+            odb_guard(odb, &::git_odb_free);
+        check(git_repository_odb(&odb, worker_repo));
+        odb_guard.reset(odb);
+        std::vector<char> buffer;
+        for (size_t i = next++; i < entries.size(); i = next++)
+        {
+            entry_t const& entry = entries[i];
+            std::filesystem::path const file = workdir / entry.m_path;
+            try
+            {
+                bool const exists = std::filesystem::exists(std::filesystem::symlink_status(file));
+                if (exists)
+                {
+                    git_oid const id = hash(worker_repo, workdir, entry, buffer);
+                    if (git_oid_equal(&id, &entry.m_id))
+                    {
+                        continue;
+                    }
+                }
+                // the object of a file which matches it is intact, so only
+                // those of mismatches are read, for a repair to check out
+                git_odb_object *object = NULL;
+                if (git_odb_read(&object, odb, &entry.m_id) < 0)
+                {
+                    outcomes[i] = outcome_t::damaged_object;
+                    continue;
+                }
+                git_odb_object_free(object);
+                outcomes[i] = (exists && is_unchanged(file, entry)) ? outcome_t::corrupt : outcome_t::modified;
+            }
+            catch (std::exception const& e)
+            {
+                outcomes[i] = outcome_t::failed;
+                failures[i] = e.what();
+            }
+        }
+    });
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        if (outcomes[i] == outcome_t::modified)
+        {
+            result.m_modified.push_back(entries[i].m_path);
+        }
+        else if (outcomes[i] == outcome_t::corrupt)
+        {
+            result.m_corrupt.push_back(entries[i].m_path);
+        }
+        else if (outcomes[i] == outcome_t::damaged_object)
+        {
+            result.m_damaged_objects.push_back(entries[i].m_path);
+        }
+        else if (outcomes[i] == outcome_t::failed)
+        {
+            result.m_failed.push_back(entries[i].m_path + ": " + failures[i]);
+        }
+    }
+    std::vector<char*> paths;
+    if (repair != repo::repair_t::none)
+    {
+        for (std::string& path : result.m_corrupt)
+        {
+            paths.push_back(&path[0]);
+        }
+    }
+    if (repair == repo::repair_t::all)
+    {
+        for (std::string& path : result.m_modified)
+        {
+            paths.push_back(&path[0]);
+        }
+    }
+    if (!paths.empty())
+    {
+        git_checkout_options checkout_options = GIT_CHECKOUT_OPTIONS_INIT;
+        checkout_options.checkout_strategy = GIT_CHECKOUT_FORCE | GIT_CHECKOUT_DISABLE_PATHSPEC_MATCH;
+        checkout_options.paths.strings = paths.data();
+        checkout_options.paths.count = paths.size();
+        check(git_checkout_index(repo, NULL, &checkout_options));
+        result.m_repaired = true;
+    }
+}
+
+struct submodule_paths_t
+{
+    std::filesystem::path m_repo_path;
+    std::vector<std::filesystem::path>* m_paths;
+};
+
+int add_submodule_path(git_submodule *sm, char const *name, void *payload)
+{
+    submodule_paths_t* submodule_paths = static_cast<submodule_paths_t*>(payload);
+    std::filesystem::path const path = submodule_paths->m_repo_path / git_submodule_path(sm);
+    // not checked out
+    if (!std::filesystem::exists(path / ".git"))
+    {
+        return 0;
+    }
+    submodule_paths->m_paths->push_back(path);
+    std::vector<std::filesystem::path> const nested = repo::get_submodule_paths(path);
+    submodule_paths->m_paths->insert(submodule_paths->m_paths->end(), nested.begin(), nested.end());
+    return 0;
+}
+
+}; // anonymous
+
+namespace repo
+{
+
+verify_result_t verify(std::filesystem::path const& repo_path, unsigned jobs, repair_t repair)
+{
+    verify_result_t result;
+    result.m_path = repo_path;
+    try
+    {
+        if (!std::filesystem::exists(repo_path))
+        {
+            throw std::runtime_error("not cloned");
+        }
+        verify_repository(result, jobs, repair);
+    }
+    catch (std::exception const& e)
+    {
+        result.m_error = e.what();
+    }
+    return result;
+}
+
+std::vector<std::filesystem::path> get_submodule_paths(std::filesystem::path const& repo_path)
+{
+    std::vector<std::filesystem::path> paths;
+    git_repository *repo = NULL;
+    if (git_repository_open(&repo, repo_path.string().c_str()) < 0)
+    {
+        return paths;
+    }
+    std::unique_ptr<git_repository, decltype(&::git_repository_free)>
+        repo_guard(repo, &::git_repository_free);
+    submodule_paths_t submodule_paths = { repo_path, &paths };
+    // lists what it can when .gitmodules cannot be read
+    git_submodule_foreach(repo, add_submodule_path, &submodule_paths);
+    return paths;
+}
+
+void print_verify_results(std::ostream& os, std::vector<verify_result_t> const& results)
+{
+    size_t width = 10;
+    for (verify_result_t const& result : results)
+    {
+        width = std::max(width, result.m_path.string().size());
+    }
+    os << std::left << std::setw(width) << "repository" << "  " << std::right << std::setw(8) << "files" << "  "
+        << std::setw(8) << "modified" << "  " << std::setw(7) << "corrupt" << "  " << std::setw(7) << "objects" << "  "
+        << std::left << "note" << std::endl;
+    for (verify_result_t const& result : results)
+    {
+        os << std::left << std::setw(width) << result.m_path.string() << "  " << std::right << std::setw(8)
+            << result.m_files << "  " << std::setw(8) << result.m_modified.size() << "  " << std::setw(7)
+            << result.m_corrupt.size() << "  " << std::setw(7) << result.m_damaged_objects.size() << "  " << std::left;
+        if (!result.m_error.empty())
+        {
+            os << result.m_error;
+        }
+        else if (!result.m_damaged_objects.empty())
+        {
+            // a checkout cannot help, the objects must be fetched again
+            os << "objects damaged, re-clone";
+        }
+        else if (result.m_repaired)
+        {
+            os << "repaired";
+        }
+        else if (!result.m_corrupt.empty())
+        {
+            os << "corrupt, not repaired";
+        }
+        os << std::endl;
+        for (std::string const& path : result.m_corrupt)
+        {
+            os << "    " << path << " (corrupt)" << std::endl;
+        }
+        for (std::string const& path : result.m_damaged_objects)
+        {
+            os << "    " << path << " (object damaged)" << std::endl;
+        }
+        for (std::string const& failure : result.m_failed)
+        {
+            os << "    " << failure << " (not checked)" << std::endl;
+        }
+    }
+}
+
+}; // namespace repo
@@ -0,0 +1,61 @@
+#ifndef REPO_VERIFY
+#define REPO_VERIFY
+
+#include <filesystem>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace repo
+{
+
+// Which mismatching files verify() checks out again
+enum class repair_t
+{
+    none,
+    // files which were damaged, not edited, e.g. by a crash
+    corrupt,
+    // also modified and missing files, e.g. after a copy which did not keep
+    // the modification times, so that corruption cannot be told from edits
+    all
+};
+
+struct verify_result_t
+{
+    std::filesystem::path m_path;
+    size_t m_files = 0;
+    // files changed since they were checked out, i.e. whose content and
+    // size or modification time differ from the index, and missing files,
+    // relative to m_path
+    std::vector<std::string> m_modified;
+    // files whose content does not hash to the object ID in the index, but
+    // whose size and modification time still match it, so that they were
+    // damaged rather than edited
+    std::vector<std::string> m_corrupt;
+    // files whose object the object database does not have, or cannot read
+    // back with the hash of its ID
+    std::vector<std::string> m_damaged_objects;
+    // files which could not be checked, each followed by the reason
+    std::vector<std::string> m_failed;
+    bool m_repaired = false;
+    std::string m_error;
+};
+
+// Re-hashes the files of the working tree in 'repo_path' on 'jobs' threads
+// and compares them with the object IDs in its index. Only for a file
+// which does not match, reads its object from the object database, which
+// verifies the object's hash. With 'repair', checks the corrupt files, or
+// all mismatching files, out of the index again, unless their objects are
+// damaged too. Submodules are not descended into. Never throws; failures
+// are reported in m_error, or per file in m_failed.
+verify_result_t verify(std::filesystem::path const& repo_path, unsigned jobs, repair_t repair);
+
+// The paths of the checked out submodules of the repository in 'repo_path',
+// and of their submodules, depth first
+std::vector<std::filesystem::path> get_submodule_paths(std::filesystem::path const& repo_path);
+
+void print_verify_results(std::ostream& os, std::vector<verify_result_t> const& results);
+
+}; // namespace repo
+
+#endif // REPO_VERIFY